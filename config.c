@@ -48,7 +48,14 @@ static const char *config_keys[CONFIG_COUNT]
 {
 	"version",
 	"audio_in",
-	"audio_out"
+	"audio_out",
+	"rows",
+	"skimmer_rate",
+	"skimmer_iq",
+	"skimmer_pow2",
+	"threads",
+	"buffer_ms",
+	"sync_ms"
 };
 
 static const char *config_values[CONFIG_COUNT];
@@ -184,6 +191,7 @@ int main(void)
 	config_set(CONFIG_VERSION, "foo");
 	config_set(CONFIG_AUDIO_INPUT, "bar");
 	config_set(CONFIG_AUDIO_OUTPUT, "baz");
+	config_set(CONFIG_SKIMMER_RATE, "192000");
 	ASSERT(!strcmp(config_get(CONFIG_VERSION), "foo"));
 	ASSERT(!strcmp(config_get(CONFIG_AUDIO_INPUT), "bar"));
 	ASSERT(!strcmp(config_get(CONFIG_AUDIO_OUTPUT), "baz"));
@@ -195,16 +203,20 @@ int main(void)
 	config_set(CONFIG_VERSION, 0);
 	config_set(CONFIG_AUDIO_INPUT, 0);
 	config_set(CONFIG_AUDIO_OUTPUT, 0);
+	config_set(CONFIG_SKIMMER_RATE, 0);
 
 	ASSERT(!config_get(CONFIG_VERSION));
 	ASSERT(!config_get(CONFIG_AUDIO_INPUT));
 	ASSERT(!config_get(CONFIG_AUDIO_OUTPUT));
+	ASSERT(!config_get(CONFIG_SKIMMER_RATE));
 
 	ASSERT(!config_load(TEST_PATH, TEST_FILENAME));
 
 	ASSERT(!strcmp(config_get(CONFIG_VERSION), "foo"));
 	ASSERT(!strcmp(config_get(CONFIG_AUDIO_INPUT), "bar"));
 	ASSERT(!strcmp(config_get(CONFIG_AUDIO_OUTPUT), "baz"));
+	ASSERT(!strcmp(config_get(CONFIG_SKIMMER_RATE), "192000"));
+	ASSERT(!config_get(CONFIG_SKIMMER_IQ));
 
 	return(assert_errors);
 }
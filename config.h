@@ -35,6 +35,13 @@ typedef enum
 	CONFIG_VERSION=0,
 	CONFIG_AUDIO_INPUT,
 	CONFIG_AUDIO_OUTPUT,
+	CONFIG_ROWS,
+	CONFIG_SKIMMER_RATE,
+	CONFIG_SKIMMER_IQ,
+	CONFIG_SKIMMER_POW2,
+	CONFIG_THREADS,
+	CONFIG_BUFFER_MS,
+	CONFIG_SYNC_MS,
 	CONFIG_COUNT
 } config_t;
 
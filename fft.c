@@ -0,0 +1,464 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+#include "simd.h"
+#if !defined(FFT_TABLE)
+#include "fft_table.h"
+#endif
+
+#define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
+
+#define FFT_ROUND(x)		(((x) + (1LL << (FFT_TWIDDLE_BITS - 1))) >> FFT_TWIDDLE_BITS)
+
+// cache line alignment of the tables
+#define FFT_ALIGN			64
+
+/*
+ * twiddles are stored in the order the butterflies use them, the stage
+ * with span s being e^(-j*pi*k/s) for k < s at twiddles + s - 1, so every
+ * transform of up to size points reads the first size - 1 of them in
+ * sequence, and the last stage doubles as the real split's twiddles
+ *
+ * Sizes up to 2^FFT_TABLE_LOG_SIZE share the table built with the
+ * program, larger ones have their own.  reverse is the bit-reversed
+ * index for size.
+ */
+struct fft_struct
+{
+	int log_size;
+	const fft_complex_t *twiddles;
+	fft_complex_t *own_twiddles;
+	unsigned int *reverse;
+};
+
+
+fft_t fft(int log_size);
+void fft_complex(fft_t fft, fft_complex_t *data);
+void fft_dlete(fft_t fft);
+void fft_real(fft_t fft, const signed short *input, fft_complex_t *output);
+static fft_complex_t fft_split(fft_complex_t a, fft_complex_t b, fft_complex_t twiddle);
+static void fft_transform(fft_t fft, fft_complex_t *data, int log_size);
+static void fft_twiddles(fft_complex_t *twiddles, int log_size);
+
+
+
+fft_t fft(int log_size)
+{
+	fft_t fft = 0;
+	unsigned int i, j, size;
+
+
+	if(log_size < 1 || log_size > FFT_LOG_SIZE_MAX) return(0);
+
+	size = 1 << log_size;
+
+	fft = (fft_t) calloc(1, sizeof(struct fft_struct));
+
+	fft->log_size = log_size;
+	fft->reverse = (unsigned int *) aligned_alloc(FFT_ALIGN, (size * sizeof(unsigned int) + FFT_ALIGN - 1) & ~(FFT_ALIGN - 1));
+
+#if !defined(FFT_TABLE)
+	if(log_size <= FFT_TABLE_LOG_SIZE)
+	{
+		fft->twiddles = fft_table;
+	}
+	else
+#endif
+	{
+		fft->own_twiddles = (fft_complex_t *) aligned_alloc(FFT_ALIGN, (size * sizeof(fft_complex_t) + FFT_ALIGN - 1) & ~(FFT_ALIGN - 1));
+		fft_twiddles(fft->own_twiddles, log_size);
+		fft->twiddles = fft->own_twiddles;
+	}
+
+	for(i = 0; i < size; i++)
+	{
+		fft->reverse[i] = 0;
+		for(j = 0; j < (unsigned int) log_size; j++)
+		{
+			if(i & (1 << j))
+			{
+				fft->reverse[i] |= 1 << (log_size - 1 - j);
+			}
+		}
+	}
+
+	return(fft);
+}
+
+// forward transform of 2^log_size complex points, in place
+void fft_complex(fft_t fft, fft_complex_t *data)
+{
+	if(!fft || !data) return;
+
+	fft_transform(fft, data, fft->log_size);
+}
+
+void fft_dlete(fft_t fft)
+{
+	if(!fft) return;
+
+	if(fft->own_twiddles)
+	{
+		free(fft->own_twiddles);
+		fft->own_twiddles = 0;
+	}
+	fft->twiddles = 0;
+
+	if(fft->reverse)
+	{
+		free(fft->reverse);
+		fft->reverse = 0;
+	}
+
+	free(fft);
+}
+
+/*
+ * forward transform of 2^log_size real points, giving bins 0 to 2^(log_size-1) inclusive
+ *
+ * The even/odd samples are packed as one half-length complex transform
+ * in output, which is then split in place into the real spectrum.
+ */
+void fft_real(fft_t fft, const signed short *input, fft_complex_t *output)
+{
+	register const fft_complex_t *twiddles;
+	fft_complex_t a, b;
+	int i, half;
+
+
+	if(!fft || !input || !output) return;
+
+	half = 1 << (fft->log_size - 1);
+	twiddles = fft->twiddles + half - 1;
+
+	for(i = 0; i < half; i++)
+	{
+		output[i].real = input[2 * i];
+		output[i].imag = input[2 * i + 1];
+	}
+
+	fft_transform(fft, output, fft->log_size - 1);
+
+	a = output[0];
+	output[0].real = a.real + a.imag;
+	output[0].imag = 0;
+	output[half].real = a.real - a.imag;
+	output[half].imag = 0;
+
+	for(i = 1; i <= half / 2; i++)
+	{
+		a = output[i];
+		b = output[half - i];
+
+		output[i] = fft_split(a, b, twiddles[i]);
+		output[half - i] = fft_split(b, a, twiddles[half - i]);
+	}
+}
+
+// one bin of the real spectrum from bins k and half-k of the packed transform
+static fft_complex_t fft_split(fft_complex_t a, fft_complex_t b, fft_complex_t twiddle)
+{
+	fft_complex_t even, odd, ret;
+	long long real, imag;
+
+
+	even.real = a.real + b.real;
+	even.imag = a.imag - b.imag;
+
+// odd is -j * (a - conj(b))
+	odd.real = a.imag + b.imag;
+	odd.imag = b.real - a.real;
+
+	real = FFT_ROUND((long long) odd.real * twiddle.real - (long long) odd.imag * twiddle.imag);
+	imag = FFT_ROUND((long long) odd.real * twiddle.imag + (long long) odd.imag * twiddle.real);
+
+	ret.real = (even.real + real) >> 1;
+	ret.imag = (even.imag + imag) >> 1;
+
+	return(ret);
+}
+
+static void fft_transform(fft_t fft, fft_complex_t *data, int log_size)
+{
+	fft_complex_t t;
+	int i, j, size = 1 << log_size, span, shift = fft->log_size - log_size;
+
+
+// bit-reversed reordering
+	for(i = 0; i < size; i++)
+	{
+		j = fft->reverse[i] >> shift;
+		if(i < j)
+		{
+			t = data[i];
+			data[i] = data[j];
+			data[j] = t;
+		}
+	}
+
+// decimation-in-time butterflies, each group's span of them at once
+	for(span = 1; span < size; span <<= 1)
+	{
+		for(i = 0; i < size; i += 2 * span)
+		{
+			simd_butterflies((int *) (data + i), (int *) (data + i + span), (const int *) (fft->twiddles + span - 1), FFT_TWIDDLE_BITS, span);
+		}
+	}
+}
+
+// the 2^log_size - 1 twiddles of every stage up to a transform of 2^log_size points
+static void fft_twiddles(fft_complex_t *twiddles, int log_size)
+{
+	int span, k;
+
+
+	for(span = 1; span < (1 << log_size); span <<= 1)
+	{
+		for(k = 0; k < span; k++)
+		{
+			twiddles[span - 1 + k].real = lround((1 << FFT_TWIDDLE_BITS) * cos((M_PI * k) / span));
+			twiddles[span - 1 + k].imag = -lround((1 << FFT_TWIDDLE_BITS) * sin((M_PI * k) / span));
+		}
+	}
+}
+
+
+
+#if defined(FFT_TABLE)
+
+#include <stdio.h>
+
+// writes fft_table.h, the shared twiddles for sizes up to 2^FFT_TABLE_LOG_SIZE
+int main(int argc, char **argv)
+{
+	fft_complex_t *twiddles = 0;
+	int log_size = argc > 1 ? atoi(argv[1]) : 12;
+	int i, size = 1 << log_size;
+
+
+	if(log_size < 1 || log_size > FFT_LOG_SIZE_MAX) return(1);
+
+	twiddles = (fft_complex_t *) calloc(size, sizeof(fft_complex_t));
+	fft_twiddles(twiddles, log_size);
+
+	printf("/* generated by fft.c with -DFFT_TABLE, do not edit */\n\n");
+	printf("#define FFT_TABLE_LOG_SIZE\t%d\n\n", log_size);
+	printf("static const fft_complex_t fft_table[%d] __attribute__((aligned(%d))) =\n{\n", size - 1, FFT_ALIGN);
+	for(i = 0; i < size - 1; i++)
+	{
+		printf("\t{ %d, %d },\n", twiddles[i].real, twiddles[i].imag);
+	}
+	printf("};\n");
+
+	free(twiddles);
+
+	return(0);
+}
+
+#endif
+
+
+
+#if defined(TEST)
+
+#include <stdio.h>
+
+static int assert_errors = 0;
+
+#define ASSERT(test)	{if(!(test)) {fprintf(stderr, "%s:%d: test \"%s\" failed\n", __FILE__, __LINE__, #test); assert_errors++;}}
+
+#define TEST_LOG_SIZE_MAX	10
+#define TEST_SIZE_MAX		(1 << TEST_LOG_SIZE_MAX)
+
+static fft_complex_t test_data[TEST_SIZE_MAX];
+static fft_complex_t test_scalar[TEST_SIZE_MAX];
+static fft_complex_t test_scalar_real[TEST_SIZE_MAX / 2 + 1];
+static fft_complex_t test_input[TEST_SIZE_MAX];
+static signed short test_real[TEST_SIZE_MAX];
+
+// reference DFT, returns the worst error of the fixed-point bins as a fraction of full scale
+static double test_dft_error(const fft_complex_t *input, const fft_complex_t *output, int log_size, int bins)
+{
+	double real, imag, error, worst = 0;
+	int i, k, size = 1 << log_size;
+
+
+	for(k = 0; k < bins; k++)
+	{
+		real = 0; imag = 0;
+
+		for(i = 0; i < size; i++)
+		{
+			real += input[i].real * cos((2.0 * M_PI * i * k) / size) + input[i].imag * sin((2.0 * M_PI * i * k) / size);
+			imag += input[i].imag * cos((2.0 * M_PI * i * k) / size) - input[i].real * sin((2.0 * M_PI * i * k) / size);
+		}
+
+		error = hypot(real - output[k].real, imag - output[k].imag);
+		if(error > worst) worst = error;
+	}
+
+	return(worst / (32768.0 * size));
+}
+
+int main(void)
+{
+	fft_t f = 0;
+	simd_t variant;
+	int log_size, i, size;
+	double error;
+
+
+	ASSERT(!fft(0));
+	ASSERT(!fft(FFT_LOG_SIZE_MAX + 1));
+
+// complex input against a reference DFT
+
+	for(log_size = 1; log_size <= TEST_LOG_SIZE_MAX; log_size++)
+	{
+		size = 1 << log_size;
+		f = fft(log_size);
+		ASSERT(f);
+
+		for(i = 0; i < size; i++)
+		{
+			test_input[i].real = (signed short) random();
+			test_input[i].imag = (signed short) random();
+		}
+
+		memmove(test_data, test_input, size * sizeof(*test_data));
+		fft_complex(f, test_data);
+
+		error = test_dft_error(test_input, test_data, log_size, size);
+		ASSERT(error < 1.0 / 65536);
+if(assert_errors) fprintf(stderr, "fft_complex(log_size=%d) error=%g\n", log_size, error);
+
+// real input against a reference DFT
+
+		for(i = 0; i < size; i++)
+		{
+			test_real[i] = (signed short) random();
+			test_input[i].real = test_real[i];
+			test_input[i].imag = 0;
+		}
+
+		fft_real(f, test_real, test_data);
+
+		error = test_dft_error(test_input, test_data, log_size, size / 2 + 1);
+		ASSERT(error < 1.0 / 65536);
+if(assert_errors) fprintf(stderr, "fft_real(log_size=%d) error=%g\n", log_size, error);
+
+		fft_dlete(f);
+	}
+
+// every variant of the butterflies gives the scalar transform bit for bit,
+// full scale input included
+
+	for(log_size = 1; log_size <= TEST_LOG_SIZE_MAX; log_size++)
+	{
+		size = 1 << log_size;
+		f = fft(log_size);
+
+		for(i = 0; i < size; i++)
+		{
+			test_input[i].real = (random() & 7) ? (signed short) random() : -32768;
+			test_input[i].imag = (random() & 7) ? (signed short) random() : -32768;
+			test_real[i] = test_input[i].real;
+		}
+
+		for(variant = SIMD_SCALAR; variant < SIMD_COUNT; variant++)
+		{
+			if(simd_set(variant)) continue;
+
+			memmove(test_data, test_input, size * sizeof(*test_data));
+			fft_complex(f, test_data);
+			if(variant == SIMD_SCALAR) memmove(test_scalar, test_data, size * sizeof(*test_data));
+			ASSERT(!memcmp(test_data, test_scalar, size * sizeof(*test_data)));
+
+			fft_real(f, test_real, test_data);
+			if(variant == SIMD_SCALAR) memmove(test_scalar_real, test_data, (size / 2 + 1) * sizeof(*test_data));
+			ASSERT(!memcmp(test_data, test_scalar_real, (size / 2 + 1) * sizeof(*test_data)));
+if(assert_errors) fprintf(stderr, "log_size=%d, variant %d\n", log_size, variant);
+		}
+
+		simd_set(SIMD_SCALAR);
+		fft_dlete(f);
+	}
+
+// a tone lands in one bin
+
+	log_size = 7;
+	size = 1 << log_size;
+	f = fft(log_size);
+
+	for(i = 0; i < size; i++)
+	{
+		test_real[i] = 10000 * cos((2.0 * M_PI * 13 * i) / size);
+	}
+
+	fft_real(f, test_real, test_data);
+
+	for(i = 0; i <= size / 2; i++)
+	{
+		if(i == 13)
+		{
+			ASSERT((FFT_POW2(test_data[i]) >> (2 * log_size)) > 20000000);
+		}
+		else
+		{
+			ASSERT((FFT_POW2(test_data[i]) >> (2 * log_size)) < 10);
+		}
+if(assert_errors) fprintf(stderr, "bin %d power=%lld\n", i, FFT_POW2(test_data[i]) >> (2 * log_size));
+	}
+
+	fft_dlete(f);
+
+// larger sizes build the same twiddles as the shared table
+
+	f = fft(FFT_TABLE_LOG_SIZE + 1);
+	ASSERT(f->own_twiddles);
+	ASSERT(!memcmp(f->twiddles, fft_table, sizeof(fft_table)));
+	fft_dlete(f);
+
+	f = fft(FFT_TABLE_LOG_SIZE);
+	ASSERT(f->twiddles == fft_table);
+	ASSERT(!f->own_twiddles);
+	fft_dlete(f);
+
+	return(assert_errors);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+/*
+ * fft is an in-place, fixed-point, radix-2 FFT
+ *
+ * Twiddles are held to FFT_TWIDDLE_BITS of precision and the transform
+ * is unscaled, so a block of 2^n 16 bit samples produces bins of up to
+ * 15 + n bits.
+ */
+
+#if !defined(FFT)
+#define FFT
+
+#define FFT_TWIDDLE_BITS	14
+#define FFT_LOG_SIZE_MAX	15
+
+typedef struct fft_complex_struct
+{
+	int real;
+	int imag;
+} fft_complex_t;
+
+typedef struct fft_struct *fft_t;
+
+#define FFT_POW2(a)	(((long long) (a).real * (a).real + (long long) (a).imag * (a).imag))
+
+fft_t fft(int log_size);
+void fft_dlete(fft_t fft);
+
+void fft_complex(fft_t fft, fft_complex_t *data);
+void fft_real(fft_t fft, const signed short *input, fft_complex_t *output);
+
+#endif
@@ -37,6 +37,7 @@
 
 #include "complex.h"
 #include "morse.h"
+#include "simd.h"
 
 
 #define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
@@ -61,6 +62,25 @@
 
 #define MORSE_HISTOGRAM_MAX		0x1000
 
+// the running means are in 1/MORSE_TRACK_ONE samples, and each mark moves
+// its mean 1/2^MORSE_TRACK_SHIFT of the way towards it
+#define MORSE_TRACK_ONE			256
+#define MORSE_TRACK_SHIFT		3
+// marks tracked before a failed decode may rebuild the fist from scratch
+#define MORSE_TRACK_RESEED		32
+// a level needs at least 1/MORSE_LEVELS_SIDE of the samples
+#define MORSE_LEVELS_SIDE		16
+// characters decoded before their average length can show a wrong fist
+#define MORSE_DECODE_HITS		4
+// samples thresholded into a bitset at a time, a whole number of words
+#define MORSE_ONOFF_BITS		1024
+
+// fists whose templates are kept per thread, in sets of MORSE_TEMPLATE_WAYS
+// picked by the fist, enough for every channel a pool thread decodes
+#define MORSE_TEMPLATES			64
+#define MORSE_TEMPLATE_WAYS		2
+#define MORSE_TEMPLATE_MAX		0xFFFF
+
 typedef enum 
 {
 /* 0123456789 */
@@ -93,6 +113,12 @@ typedef enum
 	MORSE_CODE_SEMICOLON,
 	MORSE_CODE_UNDERSCORE,
 	MORSE_CODE_DOLLAR,
+/* prosigns without a character of their own, sent as *~^#% */
+	MORSE_CODE_SK,
+	MORSE_CODE_SN,
+	MORSE_CODE_KA,
+	MORSE_CODE_HH,
+	MORSE_CODE_SOS,
 
 /* space is last */
 	MORSE_CODE_SPACE,
@@ -102,27 +128,78 @@ typedef enum
 }
 morse_code_t;
 
+// a code packed for lookup, dahs has bit i set when element i is a dah
+typedef struct
+{
+	unsigned short dahs;
+	unsigned char length;
+	char ascii;
+}
+morse_pattern_t;
+
+#if defined(MORSE_TABLE)
+static morse_pattern_t morse_table[MORSE_CODE_MAX];
+#else
+#include "morse_table.h"
+#endif
+
+// every code's expected marks and spaces for one fist, small enough to stay in L1
+struct morse_template_struct
+{
+	struct morse_fist_struct fist;
+// when it was last looked up, 0 before it is first built
+	unsigned int used;
+	unsigned char lengths[MORSE_CODE_MAX];
+// codes by element count, so a character is only scored against codes of its length
+	unsigned char bucket_sizes[MORSE_LENGTH_MAX + 1];
+	unsigned char buckets[MORSE_LENGTH_MAX + 1][MORSE_CODE_MAX];
+	struct
+	{
+		unsigned short mark, space;
+	} elements[MORSE_CODE_MAX][MORSE_LENGTH_MAX];
+};
+
 static morse_code_t morse_code_from_ascii(char character);
 static char morse_code_to_ascii(morse_code_t code);
+#if defined(MORSE_TABLE) || defined(TEST)
+static void morse_code_table(morse_pattern_t *table);
+#endif
 static int morse_code_onoff(morse_decode_t *onoff, int onoff_length, morse_code_t code, morse_fist_t fist);
 int morse_decode(morse_decode_t *output, int output_size, morse_time_t output_offset, const db_t *input, int input_size, db_t threshold, morse_fist_t fist);
-static int morse_decode_fist(morse_fist_t fist, const morse_decode_t *input, int input_size);
+static int morse_decode_fist(morse_fist_t fist, morse_decode_t *input, int input_size);
+static inline int morse_decode_append(morse_decode_t *output, int output_size, int ret, int *mark, int above, morse_time_t length);
+static int morse_decode_ages(morse_decode_t *output, int output_size, int ret);
 static int morse_decode_length(morse_decode_t *output, int output_size);
 static int morse_decode_onoff(morse_decode_t *output, int output_size, morse_time_t output_offset, const db_t *input, int input_size, db_t threshold);
+int morse_decode_runs(morse_decode_t *output, int output_size, const morse_time_t *runs, int runs_size, int mark, morse_fist_t fist);
+static int morse_decode_start(morse_decode_t *output, int output_size, int *mark);
+static int morse_decode_symbols(morse_decode_t *output, int output_size, int ret, morse_fist_t fist);
+static inline int morse_decode_run(const unsigned long long *bits, int first, int count, int above);
 static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist_t fist);
 static db_t morse_decode_threshold(const db_t *input, int input_size);
+static void morse_decode_track(morse_fist_t fist, morse_decode_t *input, int input_size);
 int morse_encode(db_t *output, int output_size, db_t mark, const char *string, morse_fist_t fist);
 morse_fist_t morse_fist(void);
 void morse_fist_dlete(morse_fist_t fist);
 void morse_fist_wpm_set(morse_fist_t fist, int sample_per_min, int wpm, int farnsworth_wpm);
 int morse_fist_wpm_get(morse_fist_t fist, int sample_per_min);
+static void morse_fist_means(morse_fist_t fist);
+static const struct morse_template_struct *morse_template(morse_fist_t fist);
+static unsigned int morse_template_set(morse_fist_t fist);
 
 int morse_text(char *text, int text_size, const morse_decode_t *output, int output_size);
+db_t morse_threshold(const unsigned int *histogram, db_t *off, db_t *on, int *bimodality);
 int morse_trim(morse_decode_t *output, int output_size, int trim_characters);
 int morse_trim_age(morse_decode_t *output, int output_size, morse_time_t age);
 
+// shared by every channel a thread decodes, and rebuilt only for a new fist
+static _Thread_local struct morse_template_struct morse_templates[MORSE_TEMPLATES];
+static _Thread_local unsigned int morse_templates_used;
+static _Thread_local unsigned long morse_templates_built;
 
 
+#if defined(MORSE_TABLE) || defined(TEST)
+// parsed into morse_table.h when building, nothing reads them at run time
 static const char *morse_codes[MORSE_CODE_MAX]=
 {
 /* 0123456789 */
@@ -142,11 +219,13 @@ static const char *morse_codes[MORSE_CODE_MAX]=
 /* !&;_$ */
 	"-.-.--", ".-...", "-.-.-.", "..--.-", "...-..-",
 
-// TODO: prosigns
+/* SK SN KA HH SOS */
+	"...-.-", "...-.", "-.-.-", "........", "...---...",
 
 /* space is last */
 	"/"
 };
+#endif
 
 static morse_code_t morse_ascii[MORSE_ASCII_MAX - MORSE_ASCII_MIN + 1]=
 {
@@ -154,14 +233,14 @@ static morse_code_t morse_ascii[MORSE_ASCII_MAX - MORSE_ASCII_MIN + 1]=
 	MORSE_CODE_SPACE,
 	MORSE_CODE_EXCLAMATION,
 	MORSE_CODE_QUOTE,
-	MORSE_CODE_NONE,
+	MORSE_CODE_HH,
 	MORSE_CODE_DOLLAR,
-	MORSE_CODE_NONE,
+	MORSE_CODE_SOS,
 	MORSE_CODE_AMPERSAND,
 	MORSE_CODE_APOSTROPHE,
 	MORSE_CODE_BRACKET_OPEN,
 	MORSE_CODE_BRACKET_CLOSE,
-	MORSE_CODE_NONE,
+	MORSE_CODE_SK,
 	MORSE_CODE_PLUS,
 	MORSE_CODE_COMMA,
 	MORSE_CODE_DASH,
@@ -219,7 +298,7 @@ static morse_code_t morse_ascii[MORSE_ASCII_MAX - MORSE_ASCII_MIN + 1]=
 	MORSE_CODE_BRACKET_OPEN,
 	MORSE_CODE_NONE,
 	MORSE_CODE_BRACKET_CLOSE,
-	MORSE_CODE_NONE,
+	MORSE_CODE_KA,
 	MORSE_CODE_UNDERSCORE,
 
 /* `abcdefghijklmno */
@@ -255,7 +334,7 @@ static morse_code_t morse_ascii[MORSE_ASCII_MAX - MORSE_ASCII_MIN + 1]=
 	MORSE_CODE_BRACKET_OPEN,
 	MORSE_CODE_NONE,
 	MORSE_CODE_BRACKET_CLOSE,
-	MORSE_CODE_NONE,
+	MORSE_CODE_SN,
 	MORSE_CODE_NONE,
 };
 
@@ -274,21 +353,48 @@ static morse_code_t morse_code_from_ascii(char character)
 
 static char morse_code_to_ascii(morse_code_t code)
 {
-	int i;
+	if(code < MORSE_CODE_MAX)
+	{
+		return(morse_table[code].ascii);
+	}
+
+	return(0);
+}
+
+#if defined(MORSE_TABLE) || defined(TEST)
+static void morse_code_table(morse_pattern_t *table)
+{
+	int code, i;
 
-	if(code != MORSE_CODE_NONE)
+
+	bzero(table, MORSE_CODE_MAX * sizeof(*table));
+
+	for(code = 0; code < MORSE_CODE_MAX; code++)
 	{
+		if(code != MORSE_CODE_SPACE)
+		{
+			for(i = 0; morse_codes[code][i]; i++)
+			{
+				if(morse_codes[code][i] == '-')
+				{
+					table[code].dahs |= 1 << i;
+				}
+			}
+			table[code].length = i;
+		}
+
+// the first character sent as the code is the one it decodes to
 		for(i = 0; i < MORSE_ASCII_MAX - MORSE_ASCII_MIN; i++)
 		{
 			if(code == morse_ascii[i])
 			{
-				return(i + MORSE_ASCII_MIN);
-			} 
+				table[code].ascii = i + MORSE_ASCII_MIN;
+				break;
+			}
 		}
 	}
-
-	return(0);
 }
+#endif
 
 static int morse_code_onoff(morse_decode_t *onoff, int onoff_length, morse_code_t code, morse_fist_t fist)
 {
@@ -309,23 +415,17 @@ static int morse_code_onoff(morse_decode_t *onoff, int onoff_length, morse_code_
 
 	if(code != MORSE_CODE_SPACE)
 	{
-		for(i = 0; morse_codes[code][i]; i++)
+		for(i = 0; i < morse_table[code].length; i++)
 		{
-			switch(morse_codes[code][i])
+			if(morse_table[code].dahs & (1 << i))
 			{
-			case '.':
-				onoff[ret].mark = fist->dit;
-				onoff[ret].space = fist->tid;
-				break;
-
-			case '-':
 				onoff[ret].mark = fist->dah;
-				onoff[ret].space = fist->tid;
-				break;
-
-			default:
-				break;
 			}
+			else
+			{
+				onoff[ret].mark = fist->dit;
+			}
+			onoff[ret].space = fist->tid;
 			ret++;
 		}
 
@@ -341,7 +441,6 @@ static int morse_code_onoff(morse_decode_t *onoff, int onoff_length, morse_code_
 
 int morse_decode(morse_decode_t *output, int output_size, morse_time_t output_offset, const db_t *input, int input_size, db_t threshold, morse_fist_t fist)
 {
-	struct morse_fist_struct x;
 	int ret;
 
 
@@ -349,30 +448,62 @@ int morse_decode(morse_decode_t *output, int output_size, morse_time_t output_of
 
 	ret = morse_decode_onoff(output, output_size, output_offset, input, input_size, threshold);
 
-	if(ret > 10)
+	return(morse_decode_symbols(output, output_size, ret, fist));
+}
+
+// adds a run of length samples above the threshold or not, and returns the
+// index of the mark and space it ended in
+static inline int morse_decode_append(morse_decode_t *output, int output_size, int ret, int *mark, int above, morse_time_t length)
+{
+	if(above)
 	{
-		if(!fist)
+		if(!*mark) ret++;
+		*mark = 1;
+	}
+	else
+	{
+		*mark = 0;
+	}
+
+	if(ret < output_size)
+	{
+		if(*mark)
 		{
-			bzero(&x, sizeof(x));
-			fist = &x;
+			output[ret].mark += length;
 		}
-
-		if(!fist->dit || !fist->dah || !fist->tid || !fist->letter/* || !fist->word*/)
+		else
 		{
-			morse_decode_fist(fist, output, ret);
+			output[ret].space += length;
 		}
 
-		if(morse_decode_text(output, output_size, fist))
+		output[ret].age = output[ret].mark + output[ret].space;
+	}
+
+	return(ret);
+}
+
+// ages count back from the end, and the count of marks and spaces is returned
+static int morse_decode_ages(morse_decode_t *output, int output_size, int ret)
+{
+	int i;
+
+
+	for(i = ret; i >= 0; i--)
+	{
+		if(i + 1 < output_size)
 		{
-			morse_decode_fist(fist, output, ret);
-			morse_decode_text(output, output_size, fist);
+			output[i].age = output[i].mark + output[i].space + output[i + 1].age;
+		}
+		else
+		{
+			output[i].age = output[i].mark + output[i].space;
 		}
 	}
 
-	return(ret);
+	return(ret + 1);
 }
 
-static int morse_decode_fist(morse_fist_t fist, const morse_decode_t *input, int input_size)
+static int morse_decode_fist(morse_fist_t fist, morse_decode_t *input, int input_size)
 {
 	unsigned int histogram[MORSE_HISTOGRAM_MAX];
 	unsigned int i, count, average;
@@ -479,6 +610,14 @@ static int morse_decode_fist(morse_fist_t fist, const morse_decode_t *input, int
 // overwrite spaces with mark-derived values because it gives better decodes of real people :-)
 fist->tid = fist->dit;
 fist->letter = (fist->tid * 5 + 1) / 2;
+
+// the tracker starts from here, and needn't see these marks again
+		fist->dit_mean = fist->dit * MORSE_TRACK_ONE;
+		fist->dah_mean = fist->dah * MORSE_TRACK_ONE;
+		for(i = 0; i + 1 < (unsigned int) input_size && input[i].age; i++)
+		{
+			input[i].tracked = 1;
+		}
 	}
 
 	return(0);
@@ -496,14 +635,97 @@ static int morse_decode_length(morse_decode_t *output, int output_size)
 }
 
 
+/*
+ * The input is thresholded into a bitset a chunk at a time, and each run of
+ * marks or spaces is found with a count of trailing zeros rather than
+ * sample by sample, so a run costs one word per 64 samples it spans.
+ */
 static int morse_decode_onoff(morse_decode_t *output, int output_size, morse_time_t output_offset, const db_t *input, int input_size, db_t threshold)
 {
-	int i, mark = 0, ret = 0;
-	db_t last;
+	unsigned long long bits[MORSE_ONOFF_BITS / 64];
+	int i, j, chunk, length, above, mark = 0, ret = 0;
 
 
 	if(!threshold) threshold = 3;
 
+	ret = morse_decode_start(output, output_size, &mark);
+
+	for(chunk = 0; chunk < input_size; chunk += length)
+	{
+		length = input_size - chunk < MORSE_ONOFF_BITS ? input_size - chunk : MORSE_ONOFF_BITS;
+
+		simd_above(bits, input + chunk, threshold, length);
+
+		for(i = 0; i < length; i = j)
+		{
+			above = (bits[i >> 6] >> (i & 63)) & 1;
+			j = morse_decode_run(bits, i, length, above);
+
+			ret = morse_decode_append(output, output_size, ret, &mark, above, j - i);
+
+			if(ret < output_size)
+			{
+				output[ret].snr = input[chunk + j - 1];
+			}
+		}
+	}
+
+	return(morse_decode_ages(output, output_size, ret));
+}
+
+// the end of the run of bits equal to above starting at first, at most count
+static inline int morse_decode_run(const unsigned long long *bits, int first, int count, int above)
+{
+	unsigned long long word = (above ? ~bits[first >> 6] : bits[first >> 6]) >> (first & 63);
+	int i = first;
+
+
+	while(!word)
+	{
+		i = (i | 63) + 1;
+		if(i >= count) return(count);
+
+		word = above ? ~bits[i >> 6] : bits[i >> 6];
+	}
+
+	i += __builtin_ctzll(word);
+
+	return(i < count ? i : count);
+}
+
+/*
+ * The same as morse_decode, from the lengths of the runs either side of the
+ * threshold rather than the samples, the first above it if mark, so the cost
+ * is in the runs however many samples they span.  Runs carry no energy, so
+ * snr is left alone.
+ */
+int morse_decode_runs(morse_decode_t *output, int output_size, const morse_time_t *runs, int runs_size, int mark, morse_fist_t fist)
+{
+	int i, current = 0, ret;
+
+
+	ret = morse_decode_start(output, output_size, &current);
+
+	for(i = 0; i < runs_size; i++, mark = !mark)
+	{
+		if(runs[i])
+		{
+			ret = morse_decode_append(output, output_size, ret, &current, mark, runs[i]);
+		}
+	}
+
+	ret = morse_decode_ages(output, output_size, ret);
+
+	return(morse_decode_symbols(output, output_size, ret, fist));
+}
+
+// clears what follows the marks and spaces so far, and returns the index of
+// the last, whose mark is still growing unless it has a space
+static int morse_decode_start(morse_decode_t *output, int output_size, int *mark)
+{
+	int ret = 0;
+
+
 	if(output_size > 0)
 	{
 		ret = morse_decode_length(output, output_size);
@@ -512,98 +734,83 @@ static int morse_decode_onoff(morse_decode_t *output, int output_size, morse_tim
 	
 	if(!ret)
 	{
-		last = *input;
-		mark = 1;
+		*mark = 1;
 	}
 	else
 	{
-		last = output[--ret].snr;
+		ret--;
 
 		if(output[ret].space)
 		{
-			mark = 0;
+			*mark = 0;
 		}
 		else
 		{
-			mark = 1;
+			*mark = 1;
 		}
 	}
 
-	for(i = 0; i < input_size; i++)
+	return(ret);
+}
+
+// finds the fist and the text once there are enough marks and spaces
+static int morse_decode_symbols(morse_decode_t *output, int output_size, int ret, morse_fist_t fist)
+{
+	struct morse_fist_struct x;
+
+
+	if(ret > 10)
 	{
-		if(input[i] > threshold)
-		{
-			if(!mark) ret++;
-			mark = 1;
-		}
-		else
+		if(!fist)
 		{
-			mark = 0;
+			bzero(&x, sizeof(x));
+			fist = &x;
 		}
-	
-		last = input[i];
 
-		if(ret < output_size)
+		if(!fist->dit || !fist->dah || !fist->tid || !fist->letter/* || !fist->word*/)
 		{
-			if(mark)
-			{
-				output[ret].mark++;
-			}
-			else
-			{
-				output[ret].space++;
-			}
-			
-			output[ret].snr = last;
-			output[ret].age = output[ret].mark + output[ret].space;
+			morse_decode_fist(fist, output, ret);
 		}
-	}
 
+		morse_decode_track(fist, output, ret);
 
-	for(i = ret; i >= 0; i--)
-	{
-		if(i + 1 < output_size)
-		{
-			output[i].age = output[i].mark + output[i].space + output[i + 1].age;
-		}
-		else
+// the tracker follows a fist that drifts, a histogram is only rebuilt when
+// decoding fails and the tracker has had a fair chance to find it
+		if(morse_decode_text(output, output_size, fist) < 0 && fist->tracked >= MORSE_TRACK_RESEED)
 		{
-			output[i].age = output[i].mark + output[i].space;
+			morse_decode_fist(fist, output, ret);
+			morse_decode_text(output, output_size, fist);
 		}
 	}
 
-	return(ret + 1);
+	return(ret);
 }
 
 static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist_t fist)
 #if !defined(MORSE_DEBUG_ONOFF)
 {
-	morse_decode_t matches[MORSE_CODE_MAX][MORSE_LENGTH_MAX];
-	int matchlengths[MORSE_CODE_MAX];
-	int count = 0, ret = 0, i, j, best, tones = 0, letters;
+	const struct morse_template_struct *template = morse_template(fist);
+	int count = 0, ret = 0, i, j, k, best, tones = 0, letters, first;
 	morse_time_t x, score, this_score;
 	int average_length = 0, hits = 0;
 
 
-	bzero(matches, sizeof(matches));
-
-	for(i = 0; i < output_size; i++)
+	if(output_size > 0)
 	{
-		output[i].text = 0;
-		output[i].whitespace = 0;
+		count = morse_decode_length(output, output_size);
 	}
 
-	for(i = 0; i < MORSE_CODE_MAX; i++)
-	{
-		matchlengths[i] = morse_code_onoff(matches[i], MORSE_LENGTH_MAX, (morse_code_t) i, fist);
-	}
+// only the tail after the last committed character is matched again
+	for(first = count; first > 0 && !output[first - 1].committed; first--)
+		;
 
-	if(output_size > 0)
+	for(i = first; i < output_size; i++)
 	{
-		count = morse_decode_length(output, output_size);
+		output[i].text = 0;
+		output[i].whitespace = 0;
 	}
 
-	for(tones = 0; tones < count; tones++)
+	for(tones = first; tones < count; tones++)
 	{
 		best = MORSE_CODE_MAX;
 		
@@ -612,52 +819,50 @@ static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist
 
 		letters++;
 		
-		for(i = 0; i < MORSE_CODE_MAX && matchlengths[i]; i++)
+		for(k = 0; letters <= MORSE_LENGTH_MAX && tones + letters <= count && k < template->bucket_sizes[letters]; k++)
 		{
+			i = template->buckets[letters][k];
 			this_score = 0;
 
-			if(matchlengths[i] == letters && tones + matchlengths[i] <= count)
+			for(j = 0; j < letters; j++)
 			{
-				for(j = 0; j < matchlengths[i]; j++)
+				if(output[tones + j].mark > template->elements[i][j].mark)
+				{
+					x = output[tones + j].mark - template->elements[i][j].mark;
+				}
+				else
 				{
-					if(output[tones + j].mark > matches[i][j].mark)
+					x = template->elements[i][j].mark - output[tones + j].mark;
+				}
+				this_score += x * x;
+//				if(j < template->lengths[i - 1])
+				{
+					if(output[tones + j].space > template->elements[i][j].space)
 					{
-						x = output[tones + j].mark - matches[i][j].mark;
+						x = output[tones + j].space - template->elements[i][j].space;
 					}
 					else
 					{
-						x = matches[i][j].mark - output[tones + j].mark;
+						x = template->elements[i][j].space - output[tones + j].space;
 					}
 					this_score += x * x;
-//					if(j < matchlengths[i - 1])
-					{
-						if(output[tones + j].space > matches[i][j].space)
-						{
-							x = output[tones + j].space - matches[i][j].space;
-						}
-						else
-						{
-							x = matches[i][j].space - output[tones + j].space;
-						}
-						this_score += x * x;
-					}
 				}
+			}
 
-				if(this_score < score || best == MORSE_CODE_MAX)
-				{
-					score = this_score;
-					best = i;
-				}
+			if(this_score < score || best == MORSE_CODE_MAX)
+			{
+				score = this_score;
+				best = i;
 			}
 		}
 
 
 		if(best < MORSE_CODE_MAX)
 		{
-			average_length += matchlengths[best];
+			average_length += template->lengths[best];
 			hits++;
-//for(j = 0; j < matchlengths[best]; j++) fprintf(stderr, " output[tones+%d=%d]={mark=%d,space=%d}\n", j, tones + j, (int) output[tones + j].mark, (int) output[tones + j].space);
-			tones += matchlengths[best] - 1;
+//for(j = 0; j < template->lengths[best]; j++) fprintf(stderr, " output[tones+%d=%d]={mark=%d,space=%d}\n", j, tones + j, (int) output[tones + j].mark, (int) output[tones + j].space);
+			tones += template->lengths[best] - 1;
 //fprintf(stderr, "tones=%d, morse_code_to_ascii(best=%d)=\'%c\',score=%d, output[tones=%d].space=%d\n", tones, best, morse_code_to_ascii((morse_code_t) best), (int) score, tones, (int) output[tones].space);
 			output[tones].text = morse_code_to_ascii((morse_code_t) best);
 			x = output[tones].space;
@@ -669,6 +874,12 @@ static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist
 			{
 				output[tones].whitespace = ' ';
 			}
+
+// the gap after it is closed by the next mark, so nothing about it can change
+			if(tones + 1 < count)
+			{
+				output[tones].committed = 1;
+			}
 		}
 		else
 		{
@@ -676,7 +887,9 @@ static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist
 		}
 	}
 	
-	if(average_length / hits < 3)
+// a tail of a few characters says little about the fist, so it is only
+// judged once enough have been decoded
+	if(hits >= MORSE_DECODE_HITS ? average_length / hits < 3 : !hits && !first)
 	{
 		ret = -1;
 	}
@@ -701,9 +914,8 @@ static int morse_decode_text(morse_decode_t *output, int output_size, morse_fist
 
 static db_t morse_decode_threshold(const db_t *input, int input_size)
 {
-	int total = 0, i;
-	int hi = 0, hi_best = 0, lo = 0, lo_best = 0;
-	db_t histogram[1<<(sizeof(db_t)*8)];
+	unsigned int histogram[MORSE_LEVELS];
+	int i;
 
 
 	bzero(histogram, sizeof(histogram));
@@ -711,37 +923,61 @@ static db_t morse_decode_threshold(const db_t *input, int input_size)
 	for(i = 0; i < input_size; i++)
 	{
 		histogram[input[i]]++;
-		total += input[i];
 	}
-	
-	total = (total + input_size / 2) / input_size;
 
-	for(i = 0; i < (int) (sizeof(histogram)/sizeof(*histogram)); i++)
+	return(morse_threshold(histogram, 0, 0, 0));
+}
+
+/*
+ * Online two-means clustering of the marks: each mark that has ended moves
+ * the nearer of the dit and dah means a little towards it, so the fist
+ * follows the sender in O(1) per element.  The last element is still
+ * growing, so it waits for the next call.
+ */
+static void morse_decode_track(morse_fist_t fist, morse_decode_t *input, int input_size)
+{
+	long x;
+	int i, folded = 0;
+
+
+	if(!fist->dit || !fist->dah || input_size < 2)
+	{
+		return;
+	}
+
+	if(!fist->dit_mean || !fist->dah_mean)
+	{
+		fist->dit_mean = fist->dit * MORSE_TRACK_ONE;
+		fist->dah_mean = fist->dah * MORSE_TRACK_ONE;
+	}
+
+	for(i = input_size - 1; i > 0 && !input[i - 1].tracked; i--)
+		;
+
+	for(; i < input_size - 1; i++)
 	{
-		if(i < total)
+		input[i].tracked = 1;
+
+		if(input[i].mark)
 		{
-			if(histogram[i] > lo_best)
+			x = input[i].mark * MORSE_TRACK_ONE;
+			if(x * 2 < (long) (fist->dit_mean + fist->dah_mean))
 			{
-				lo_best = histogram[i];
-				lo = i;
+				fist->dit_mean += (x - (long) fist->dit_mean) / (1 << MORSE_TRACK_SHIFT);
 			}
-		}
-		else
-		{
-			if(histogram[i] > hi_best)
+			else
 			{
-				hi_best = histogram[i];
-				hi = i;
+				fist->dah_mean += (x - (long) fist->dah_mean) / (1 << MORSE_TRACK_SHIFT);
 			}
+			folded++;
 		}
 	}
 
-
-//fprintf(stderr, "morse_decode_threshold(input,%d) returns %d,hi=%d,lo=%d\n", input_size, (3 * (hi - lo)) / 4, hi, lo);
-//	return((db_t) (3 * (hi - lo)) / 4);	
-
-//fprintf(stderr, "morse_decode_threshold(input,%d) returns %d,hi=%d,lo=%d\n", input_size, ((hi + lo) / 2), hi, lo);
-	return((db_t) ((hi + lo) / 2));
+	if(folded)
+	{
+		fist->tracked += folded;
+		morse_fist_means(fist);
+	}
 }
 
 int morse_encode(db_t *output, int output_size, db_t mark, const char *string, morse_fist_t fist)
@@ -749,7 +985,6 @@ int morse_encode(db_t *output, int output_size, db_t mark, const char *string, m
 	int ret = 0;
 	unsigned int i, j, k;
 	morse_code_t code;
-	const char *morse_pattern = 0;
 
 
 	if(string && fist)
@@ -768,42 +1003,21 @@ int morse_encode(db_t *output, int output_size, db_t mark, const char *string, m
 			}
 			else
 			{
-				morse_pattern = morse_codes[code];
-				
-				if(morse_pattern)
+				for(j = 0; j < morse_table[code].length; j++)
 				{
-					for(j = 0; morse_pattern[j]; j++)
+					if(j)
 					{
-						if(j)
+						for(i = 0; i < fist->tid; i++)
 						{
-							for(i = 0; i < fist->tid; i++)
-							{
-								if(ret < output_size) output[ret] = 0;
-								ret++;
-							}
+							if(ret < output_size) output[ret] = 0;
+							ret++;
 						}
+					}
 
-						switch(morse_pattern[j])
-						{
-						case '.':
-							for(i = 0; i < fist->dit; i++)
-							{
-								if(ret < output_size) output[ret] = mark;
-								ret++;
-							}
-						break;
-
-						case '-':
-							for(i = 0; i < fist->dah; i++)
-							{
-								if(ret < output_size) output[ret] = mark;
-								ret++;
-							}
-						break;
-
-						default:
-							break;
-						}
+					for(i = 0; i < (morse_table[code].dahs & (1 << j) ? fist->dah : fist->dit); i++)
+					{
+						if(ret < output_size) output[ret] = mark;
+						ret++;
 					}
 				}
 
@@ -847,6 +1061,9 @@ void morse_fist_wpm_set(morse_fist_t fist, int sample_per_min, int wpm, int farn
 // TODO: this calculation is not right
 		fist->letter = (MORSE_LETTER * sample_per_min) / (farnsworth_wpm * MORSE_PARIS_DITS);
 //		fist->word = (MORSE_WORD * sample_per_min) / (farnsworth_wpm * MORSE_PARIS_DITS);
+		fist->dit_mean = fist->dit * MORSE_TRACK_ONE;
+		fist->dah_mean = fist->dah * MORSE_TRACK_ONE;
+		fist->tracked = 0;
 	}
 }
 
@@ -864,6 +1081,96 @@ int morse_fist_wpm_get(morse_fist_t fist, int sample_per_min)
 	return(0);
 }
 
+// rounds the tracked means into the fist, with the same checks as a histogram
+static void morse_fist_means(morse_fist_t fist)
+{
+	if(fist->dah_mean < fist->dit_mean * 2)
+	{
+		fist->dah_mean = fist->dit_mean * 3;
+	}
+
+	fist->dit = (fist->dit_mean + MORSE_TRACK_ONE / 2) / MORSE_TRACK_ONE;
+	fist->dah = (fist->dah_mean + MORSE_TRACK_ONE / 2) / MORSE_TRACK_ONE;
+
+	if(!fist->dit)
+	{
+		fist->dit = 1;
+	}
+
+	if(fist->dah < fist->dit * 3)
+	{
+		fist->dah = fist->dit * 3;
+	}
+
+	fist->tid = fist->dit;
+	fist->letter = (fist->tid * 5 + 1) / 2;
+}
+
+static const struct morse_template_struct *morse_template(morse_fist_t fist)
+{
+	struct morse_template_struct *template = 0, *set;
+	morse_decode_t onoff[MORSE_LENGTH_MAX];
+	unsigned int i, j;
+
+
+	set = morse_templates + morse_template_set(fist) * MORSE_TEMPLATE_WAYS;
+	morse_templates_used++;
+
+	for(i = 0; i < MORSE_TEMPLATE_WAYS; i++)
+	{
+		if(set[i].used
+			&& set[i].fist.dit == fist->dit && set[i].fist.dah == fist->dah
+			&& set[i].fist.tid == fist->tid && set[i].fist.letter == fist->letter)
+		{
+			set[i].used = morse_templates_used;
+			return(set + i);
+		}
+
+// the least recently used is replaced, and an empty one is the oldest of all
+		if(!template || morse_templates_used - set[i].used > morse_templates_used - template->used)
+		{
+			template = set + i;
+		}
+	}
+
+	template->fist = *fist;
+	template->used = morse_templates_used;
+	morse_templates_built++;
+
+	bzero(template->bucket_sizes, sizeof(template->bucket_sizes));
+
+	for(i = 0; i < MORSE_CODE_MAX; i++)
+	{
+		template->lengths[i] = morse_code_onoff(onoff, ARRAY_SIZE(onoff), (morse_code_t) i, fist);
+
+		if(template->lengths[i] > 0 && template->lengths[i] <= MORSE_LENGTH_MAX)
+		{
+			template->buckets[template->lengths[i]][template->bucket_sizes[template->lengths[i]]++] = i;
+		}
+
+		for(j = 0; j < template->lengths[i]; j++)
+		{
+			template->elements[i][j].mark = onoff[j].mark < MORSE_TEMPLATE_MAX ? onoff[j].mark : MORSE_TEMPLATE_MAX;
+			template->elements[i][j].space = onoff[j].space < MORSE_TEMPLATE_MAX ? onoff[j].space : MORSE_TEMPLATE_MAX;
+		}
+	}
+
+	return(template);
+}
+
+// tracked fists differ mostly in dit and dah, so those spread the sets most
+static unsigned int morse_template_set(morse_fist_t fist)
+{
+	unsigned long x = fist->dit;
+
+
+	x = x * 31 + fist->dah;
+	x = x * 31 + fist->tid;
+	x = x * 31 + fist->letter;
+
+	return(x % (MORSE_TEMPLATES / MORSE_TEMPLATE_WAYS));
+}
+
 int morse_text(char *text, int text_size, const morse_decode_t *output, int output_size)
 {
 	int i, ret = 0;
@@ -889,6 +1196,66 @@ int morse_text(char *text, int text_size, const morse_decode_t *output, int outp
 	return(ret);
 }
 
+/*
+ * The energy clusters around an "off" and an "on" level, taken as the
+ * commonest values either side of the mean, and the threshold is halfway
+ * between them.  bimodality is how far apart they are in dB, or 0 when
+ * either side holds too few samples to be a level at all.
+ */
+db_t morse_threshold(const unsigned int *histogram, db_t *off, db_t *on, int *bimodality)
+{
+	unsigned long long total = 0, count = 0, below = 0;
+	unsigned int hi = 0, hi_best = 0, lo = 0, lo_best = 0, mean, i;
+
+
+	for(i = 0; i < MORSE_LEVELS; i++)
+	{
+		total += (unsigned long long) histogram[i] * i;
+		count += histogram[i];
+	}
+
+	if(!count)
+	{
+		if(off) *off = 0;
+		if(on) *on = 0;
+		if(bimodality) *bimodality = 0;
+		return(0);
+	}
+
+	mean = (total + count / 2) / count;
+
+	for(i = 0; i < MORSE_LEVELS; i++)
+	{
+		if(i < mean)
+		{
+			below += histogram[i];
+			if(histogram[i] > lo_best)
+			{
+				lo_best = histogram[i];
+				lo = i;
+			}
+		}
+		else
+		{
+			if(histogram[i] > hi_best)
+			{
+				hi_best = histogram[i];
+				hi = i;
+			}
+		}
+	}
+
+	if(off) *off = lo;
+	if(on) *on = hi;
+	if(bimodality)
+	{
+		*bimodality = (below * MORSE_LEVELS_SIDE < count || (count - below) * MORSE_LEVELS_SIDE < count) ? 0 : hi - lo;
+	}
+
+//fprintf(stderr, "morse_threshold() returns %d,hi=%d,lo=%d\n", (hi + lo) / 2, hi, lo);
+	return((db_t) ((hi + lo) / 2));
+}
+
 int morse_trim(morse_decode_t *output, int output_size, int trim_characters)
 {
 	int i, last = -1, chars = 0;
@@ -922,7 +1289,7 @@ int morse_trim(morse_decode_t *output, int output_size, int trim_characters)
 	}
 
 //	if(output[last].whitespace) chars--;
-	memmove(output, output + last + 1, (output_size - last - 1) * sizeof(output));
+	memmove(output, output + last + 1, (output_size - last - 1) * sizeof(*output));
 	bzero(output + output_size - last - 1, (last + 1) * sizeof(*output));
 
 	return(chars - trim_characters);
@@ -954,6 +1321,31 @@ int morse_trim_age(morse_decode_t *output, int output_size, morse_time_t age)
 }
 
 
+#if defined(MORSE_TABLE)
+
+// writes morse_table.h, the codes packed for encoding and decoding
+int main(void)
+{
+	int code;
+
+
+	morse_code_table(morse_table);
+
+	printf("/* generated by morse.c with -DMORSE_TABLE, do not edit */\n\n");
+	printf("static const morse_pattern_t morse_table[%d] =\n{\n", MORSE_CODE_MAX);
+	for(code = 0; code < MORSE_CODE_MAX; code++)
+	{
+		printf("\t{ 0x%03X, %d, %d },\n", morse_table[code].dahs, morse_table[code].length, morse_table[code].ascii);
+	}
+	printf("};\n");
+
+	return(0);
+}
+
+#endif
+
+
+
 #if defined(TEST)
 
 #include <stdio.h>
@@ -973,7 +1365,11 @@ static int assert_errors = 0;
 					"THE FIRST NUMBERS IN THE FIBONACCI SEQUENCE ARE:"\
 					" 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233, 377, 610 "
 
+#define TEST_PROSIGNS	"^CQ DE G0ABC K ~ SOS % # * "
+
 #define TEST_SAMPLES_PER_MIN	((60*8000)/128)
+// more than a thread's templates used to hold
+#define TEST_FISTS				16
 
 #define TEST_DECODE_MAX	10000
 static morse_decode_t test_decode[TEST_DECODE_MAX];
@@ -1102,6 +1498,49 @@ if(assert_errors) test_print_decode(stderr, decode, ARRAY_SIZE(decode), 1);
 	return((decoded * 1000) / TEST_NOISE_COUNT);
 }
 
+// what morse_decode_onoff finds, a sample at a time
+static int test_onoff(morse_decode_t *output, int output_size, const db_t *input, int input_size, db_t threshold)
+{
+	int i, mark = 1, ret = morse_decode_length(output, output_size);
+
+
+	if(ret)
+	{
+		ret--;
+		mark = !output[ret].space;
+	}
+
+	for(i = 0; i < input_size; i++)
+	{
+		if(input[i] > threshold)
+		{
+			if(!mark) ret++;
+			mark = 1;
+		}
+		else
+		{
+			mark = 0;
+		}
+
+		if(mark)
+		{
+			output[ret].mark++;
+		}
+		else
+		{
+			output[ret].space++;
+		}
+		output[ret].snr = input[i];
+	}
+
+	for(i = ret; i >= 0; i--)
+	{
+		output[i].age = output[i].mark + output[i].space + (i + 1 < output_size ? output[i + 1].age : 0);
+	}
+
+	return(ret + 1);
+}
+
 static void test_print_onoff(FILE *f, const db_t *output, db_t threshold, int count, const morse_decode_t *decode)
 {
 	int i, j;
@@ -1155,6 +1594,7 @@ int main(void)
 {
 	morse_fist_t fist = morse_fist();
 	unsigned int count, i, fragment;
+	char text;
 
 
 // Test MORSE_LENGTH_MAX is valid
@@ -1164,6 +1604,80 @@ int main(void)
 		ASSERT(strlen(morse_codes[count]) < MORSE_LENGTH_MAX);
 	}
 
+// Test levels are found in windows longer than a byte can count
+
+	{
+		unsigned int histogram[MORSE_LEVELS];
+		db_t off, on;
+		int bimodality;
+
+		for(i = 0; i < 1000; i++)
+		{
+			test_db[i] = i % 3 ? 20 : 60;
+		}
+		ASSERT(morse_decode_threshold(test_db, 1000) == 40);
+
+		bzero(histogram, sizeof(histogram));
+		histogram[20] = 700;
+		histogram[21] = 300;
+		histogram[60] = 300;
+		ASSERT(morse_threshold(histogram, &off, &on, &bimodality) == 40);
+		ASSERT(off == 20 && on == 60 && bimodality == 40);
+
+		histogram[21] = 0;
+		histogram[60] = 10;
+		morse_threshold(histogram, &off, &on, &bimodality);
+		ASSERT(!bimodality);
+
+		bzero(histogram, sizeof(histogram));
+		ASSERT(!morse_threshold(histogram, &off, &on, &bimodality) && !bimodality);
+	}
+
+// Test runs found in the bitset are those found a sample at a time, with
+// runs across words and chunks, and input arriving in fragments
+
+	{
+		static morse_decode_t expected[TEST_DECODE_MAX];
+		int size = 3 * MORSE_ONOFF_BITS + 17, run, j, k, ret, expected_ret;
+
+		for(i = 0, k = 0; i < size; i += run, k++)
+		{
+			run = 1 + random() % (k % 7 ? 20 : 200);
+			for(j = i; j < i + run && j < size; j++)
+			{
+				test_db[j] = k & 1 ? 41 + random() % 40 : random() % 41;
+			}
+		}
+
+		bzero(test_decode, sizeof(test_decode));
+		bzero(expected, sizeof(expected));
+		for(i = 0, ret = expected_ret = 0; i < size; i += run)
+		{
+			run = 1 + random() % 700;
+			if(i + run > size) run = size - i;
+
+			ret = morse_decode_onoff(test_decode, ARRAY_SIZE(test_decode), 0, test_db + i, run, 40);
+			expected_ret = test_onoff(expected, ARRAY_SIZE(expected), test_db + i, run, 40);
+			ASSERT(ret == expected_ret);
+		}
+		ASSERT(ret == k / 2 + 1);
+		ASSERT(!memcmp(test_decode, expected, sizeof(expected)));
+if(assert_errors) fprintf(stderr, "runs %d, bitset %d, per sample %d\n", k, ret, expected_ret);
+	}
+
+// Test the generated table matches the codes
+
+	{
+		morse_pattern_t table[MORSE_CODE_MAX];
+
+		morse_code_table(table);
+		ASSERT(ARRAY_SIZE(morse_table) == MORSE_CODE_MAX);
+		ASSERT(!memcmp(table, morse_table, sizeof(table)));
+		ASSERT(morse_code_to_ascii(MORSE_CODE_A) == 'A');
+		ASSERT(morse_code_to_ascii(MORSE_CODE_SOS) == '%');
+		ASSERT(!morse_code_to_ascii(MORSE_CODE_NONE));
+	}
+
 
 // Test fist functions
 	ASSERT(fist);
@@ -1225,6 +1739,22 @@ if(assert_errors) test_print_onoff(stderr, test_db, 0x40, count, test_decode);
 	ASSERT(!strcmp(test_string, TEST_OUT));
 if(assert_errors) test_print_onoff(stderr, test_db, 0x80, ARRAY_SIZE(test_db), test_decode); 
 
+// everything but the last character is committed, and not matched again
+
+	for(i = 0, fragment = 0; test_decode[i].mark || test_decode[i].space; i++)
+	{
+		if(test_decode[i].text && !test_decode[i].committed) fragment++;
+	}
+	ASSERT(fragment == 1);
+	ASSERT(test_decode[0].committed || test_decode[1].committed || test_decode[2].committed);
+	for(i = 0; !test_decode[i].committed; i++)
+		;
+	text = test_decode[i].text;
+	test_decode[i].text = '#';
+	morse_decode(test_decode, ARRAY_SIZE(test_decode), 0, test_db, 0, 3, fist);
+	ASSERT(test_decode[i].text == '#');
+	test_decode[i].text = text;
+
 // test trimming the output
 
 	ASSERT(morse_trim(test_decode, ARRAY_SIZE(test_decode), 3));
@@ -1249,6 +1779,121 @@ if(assert_errors) fprintf(stderr, "test_string=\"%s\"\n", test_string);
 
 if(assert_errors) fprintf(stderr, "morse_decode returned %d, \"%s\"\n", count, test_string); 
 
+// templates are cached per fist, and agree with morse_code_onoff
+
+	ASSERT(morse_template(fist) == morse_template(fist));
+	count = morse_code_onoff(test_decode, ARRAY_SIZE(test_decode), MORSE_CODE_A, fist);
+	ASSERT(morse_template(fist)->lengths[MORSE_CODE_A] == count);
+	for(i = 0; i < count; i++)
+	{
+		ASSERT(morse_template(fist)->elements[MORSE_CODE_A][i].mark == test_decode[i].mark);
+		ASSERT(morse_template(fist)->elements[MORSE_CODE_A][i].space == test_decode[i].space);
+	}
+
+// a thread decoding many channels keeps every one of their fists' templates
+
+	{
+		struct morse_fist_struct fists[TEST_FISTS];
+		const struct morse_template_struct *templates[TEST_FISTS];
+		unsigned long built;
+
+		for(i = 0; i < TEST_FISTS; i++)
+		{
+			fists[i] = *fist;
+			fists[i].dit = fist->dit + i;
+			fists[i].dah = fists[i].dit * 3 + i % 2;
+			fists[i].tid = fists[i].dit;
+			fists[i].letter = (fists[i].tid * 5 + 1) / 2;
+			templates[i] = morse_template(fists + i);
+		}
+
+		built = morse_templates_built;
+
+		for(fragment = 0; fragment < 4; fragment++)
+		{
+			for(i = 0; i < TEST_FISTS; i++)
+			{
+				ASSERT(morse_template(fists + i) == templates[i]);
+				ASSERT(templates[i]->fist.dit == fists[i].dit && templates[i]->fist.dah == fists[i].dah);
+			}
+		}
+
+		ASSERT(morse_templates_built == built);
+if(assert_errors) fprintf(stderr, "morse_templates_built=%lu, built=%lu\n", morse_templates_built, built);
+	}
+
+// the runs either side of the threshold decode as the samples do, with the
+// last run of each fragment carrying on into the next
+
+	{
+		static morse_decode_t expected[TEST_DECODE_MAX];
+		static morse_time_t runs[TEST_DECODE_MAX];
+		struct morse_fist_struct fist_samples = *fist, fist_runs = *fist;
+		morse_time_t part;
+		int k, runs_size, mark;
+
+		count = morse_encode(test_db, ARRAY_SIZE(test_db), 0x80, TEST_STRING, fist);
+		for(i = 0, runs_size = 0; i < count; runs_size++)
+		{
+			for(runs[runs_size] = 0, mark = test_db[i] > 3; i < count && (test_db[i] > 3) == mark; i++)
+			{
+				runs[runs_size]++;
+			}
+		}
+
+		bzero(expected, sizeof(expected));
+		morse_decode(expected, ARRAY_SIZE(expected), 0, test_db, count, 3, &fist_samples);
+
+		bzero(test_decode, sizeof(test_decode));
+		for(k = 0, mark = test_db[0] > 3; k < runs_size; k += fragment, mark ^= fragment & 1)
+		{
+			fragment = 1 + k % 5;
+			if(k + fragment > (unsigned int) runs_size) fragment = runs_size - k;
+
+			part = runs[k + fragment - 1] / 2;
+			runs[k + fragment - 1] -= part;
+			morse_decode_runs(test_decode, ARRAY_SIZE(test_decode), runs + k, fragment, mark, &fist_runs);
+			morse_decode_runs(test_decode, ARRAY_SIZE(test_decode), &part, 1, mark ^ ((fragment - 1) & 1), &fist_runs);
+		}
+
+		for(i = 0; i < TEST_DECODE_MAX; i++)
+		{
+			ASSERT(test_decode[i].age == expected[i].age && test_decode[i].mark == expected[i].mark && test_decode[i].space == expected[i].space);
+			ASSERT(test_decode[i].text == expected[i].text && test_decode[i].whitespace == expected[i].whitespace && test_decode[i].committed == expected[i].committed);
+if(assert_errors) { fprintf(stderr, "decode[%d]: runs {%d,%d,'%c'}, samples {%d,%d,'%c'}\n", i, (int) test_decode[i].mark, (int) test_decode[i].space, test_decode[i].text, (int) expected[i].mark, (int) expected[i].space, expected[i].text); break; }
+		}
+		morse_text(test_string, ARRAY_SIZE(test_string), test_decode, ARRAY_SIZE(test_decode));
+		ASSERT(!strcmp(test_string, TEST_OUT));
+	}
+
+// prosigns decode to the characters they are sent as
+
+	count = morse_encode(test_db, ARRAY_SIZE(test_db), 0x80, TEST_PROSIGNS, fist);
+	ASSERT(count < TEST_DECODE_MAX && count > 0);
+	bzero(test_decode, sizeof(test_decode));
+	morse_decode(test_decode, ARRAY_SIZE(test_decode), 0, test_db, count, 0, fist);
+	morse_text(test_string, ARRAY_SIZE(test_string), test_decode, ARRAY_SIZE(test_decode));
+	ASSERT(!strcmp(test_string, TEST_PROSIGNS));
+if(assert_errors) fprintf(stderr, "test_string=\"%s\"\n", test_string);
+
+// the fist follows a sender that slows down
+
+	fist->dit = 3; fist->dah = 9; fist->tid = 3; fist->letter = 9;
+	count = morse_encode(test_db, ARRAY_SIZE(test_db), 0x80, TEST_STRING, fist);
+	ASSERT(count < ARRAY_SIZE(test_db));
+	morse_fist_wpm_set(fist, 2 * TEST_SAMPLES_PER_MIN, 75, 75);
+	ASSERT(fist->dit == 2 && fist->dah == 6);
+	bzero(test_decode, sizeof(test_decode));
+	for(i = 0; i < count; i += fragment)
+	{
+		fragment = count - i < 0x20 ? count - i : 0x20;
+		morse_decode(test_decode, ARRAY_SIZE(test_decode), 0, test_db + i, fragment, 3, fist);
+	}
+	ASSERT(fist->dit == 3 && fist->dah == 9);
+	ASSERT(fist->tracked > MORSE_TRACK_RESEED);
+if(assert_errors) fprintf(stderr, "fist={dit=%d,dah=%d,tracked=%d}\n", (int) fist->dit, (int) fist->dah, (int) fist->tracked);
+	morse_fist_wpm_set(fist, TEST_SAMPLES_PER_MIN, 75, 75);
+
 // test aging the text
 
 	count = morse_encode(test_db, ARRAY_SIZE(test_db), 0x80, TEST_STRING, fist);
@@ -35,26 +35,38 @@
 // morse times are ages -- how many samples since this happened?
 typedef unsigned long morse_time_t;
 
+// dit_mean and dah_mean follow the marks as they arrive, in fixed point,
+// tracked counts the marks folded into them since they were last seeded
 typedef struct morse_fist_struct
 {
 	morse_time_t dit, dah;
 	morse_time_t tid, letter;
+	morse_time_t dit_mean, dah_mean, tracked;
 } *morse_fist_t;
 
-// each of these represents a mark then a space
+// each of these represents a mark then a space, committed marks the end of
+// a character that can no longer change, so it and everything before it
+// are not decoded again, tracked that it has been folded into the fist
 typedef struct morse_decode_struct
 {
 	morse_time_t age, mark, space;
 	db_t snr;
-	char text, whitespace;
+	char text, whitespace, committed, tracked;
 } morse_decode_t;
 
 int morse_encode(db_t *output, int output_size, db_t mark, const char *string, morse_fist_t fist);
 int morse_decode(morse_decode_t *output, int output_size, morse_time_t output_offset, const db_t *input, int input_size, db_t threshold, morse_fist_t fist);
+// the same from the lengths of alternate runs above and below the threshold,
+// the first above it if mark
+int morse_decode_runs(morse_decode_t *output, int output_size, const morse_time_t *runs, int runs_size, int mark, morse_fist_t fist);
 //int morse_decode_fist(morse_fist_t fist, const morse_decode_t *input, int input_size);
 
 
+// a histogram of energy has a bin for every db_t
+#define MORSE_LEVELS	(1 << (sizeof(db_t) * 8))
+
 int morse_text(char *text, int text_size, const morse_decode_t *output, int output_size);
+db_t morse_threshold(const unsigned int *histogram, db_t *off, db_t *on, int *bimodality);
 int morse_trim(morse_decode_t *output, int output_size, int trim_characters);
 int morse_trim_age(morse_decode_t *output, int output_size, morse_time_t age);
 
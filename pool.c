@@ -0,0 +1,385 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+#define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
+
+#define POOL_THREADS_MAX	256
+
+// a worker's items left, first up to but not including last, in one word so
+// the owner taking from the front and a thief taking the back never collide
+#define POOL_RANGE(first, last)	(((unsigned long long) (unsigned int) (last) << 32) | (unsigned int) (first))
+#define POOL_FIRST(range)		((int) (unsigned int) (range))
+#define POOL_LAST(range)		((int) (unsigned int) ((range) >> 32))
+
+struct pool_worker_struct
+{
+	pool_t pool;
+	int index;
+	pthread_t thread;
+	_Atomic unsigned long long range;
+};
+
+// generation counts runs, busy counts the workers still on this one
+struct pool_struct
+{
+	int threads;
+	struct pool_worker_struct *workers;
+	pthread_mutex_t mutex;
+	pthread_cond_t start, done;
+	unsigned int generation;
+	int busy, stop;
+	pool_function_t function;
+	void *blob;
+};
+
+
+pool_t pool(int threads);
+void pool_dlete(pool_t pool);
+void pool_run(pool_t pool, pool_function_t function, void *blob, int count);
+static int pool_steal(struct pool_worker_struct *thief, struct pool_worker_struct *victim);
+static int pool_take(struct pool_worker_struct *worker, int *item);
+int pool_threads(pool_t pool);
+static void pool_work(pool_t pool, int index);
+static void *pool_worker(void *blob);
+
+
+
+pool_t pool(int threads)
+{
+	pool_t pool = 0;
+
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads <= 0) threads = 1;
+	if(threads > POOL_THREADS_MAX) threads = POOL_THREADS_MAX;
+
+	pool = (pool_t) calloc(1, sizeof(struct pool_struct));
+
+	pthread_mutex_init(&pool->mutex, 0);
+	pthread_cond_init(&pool->start, 0);
+	pthread_cond_init(&pool->done, 0);
+
+	pool->workers = (struct pool_worker_struct *) calloc(threads, sizeof(struct pool_worker_struct));
+
+// worker 0 is whoever calls pool_run
+	for(pool->threads = 1; pool->threads < threads; pool->threads++)
+	{
+		pool->workers[pool->threads].pool = pool;
+		pool->workers[pool->threads].index = pool->threads;
+
+		if(pthread_create(&pool->workers[pool->threads].thread, 0, pool_worker, pool->workers + pool->threads)) break;
+	}
+
+	return(pool);
+}
+
+void pool_dlete(pool_t pool)
+{
+	int i;
+
+
+	if(!pool) return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for(i = 1; i < pool->threads; i++)
+	{
+		pthread_join(pool->workers[i].thread, 0);
+	}
+
+	if(pool->workers)
+	{
+		free(pool->workers);
+		pool->workers = 0;
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->mutex);
+
+	free(pool);
+}
+
+void pool_run(pool_t pool, pool_function_t function, void *blob, int count)
+{
+	int i;
+
+
+	if(!function || count <= 0) return;
+
+	if(!pool || pool->threads == 1)
+	{
+		function(blob, 0, count);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->function = function;
+	pool->blob = blob;
+	for(i = 0; i < pool->threads; i++)
+	{
+		atomic_store_explicit(&pool->workers[i].range, POOL_RANGE(((long long) count * i) / pool->threads, ((long long) count * (i + 1)) / pool->threads), memory_order_relaxed);
+	}
+	pool->busy = pool->threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->mutex);
+
+	pool_work(pool, 0);
+
+	pthread_mutex_lock(&pool->mutex);
+	while(pool->busy)
+	{
+		pthread_cond_wait(&pool->done, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+// moves the back half of the victim's items to the thief, whose own are done,
+// or the whole of them if there is only one
+static int pool_steal(struct pool_worker_struct *thief, struct pool_worker_struct *victim)
+{
+	unsigned long long range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+	int first, middle, last;
+
+
+	do
+	{
+		first = POOL_FIRST(range);
+		last = POOL_LAST(range);
+		if(first >= last) return(0);
+
+		middle = first + (last - first) / 2;
+	}
+	while(!atomic_compare_exchange_weak_explicit(&victim->range, &range, POOL_RANGE(first, middle), memory_order_relaxed, memory_order_relaxed));
+
+	atomic_store_explicit(&thief->range, POOL_RANGE(middle, last), memory_order_relaxed);
+
+	return(1);
+}
+
+static int pool_take(struct pool_worker_struct *worker, int *item)
+{
+	unsigned long long range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+
+
+	do
+	{
+		if(POOL_FIRST(range) >= POOL_LAST(range)) return(0);
+	}
+	while(!atomic_compare_exchange_weak_explicit(&worker->range, &range, POOL_RANGE(POOL_FIRST(range) + 1, POOL_LAST(range)), memory_order_relaxed, memory_order_relaxed));
+
+	*item = POOL_FIRST(range);
+
+	return(1);
+}
+
+int pool_threads(pool_t pool)
+{
+	return(pool ? pool->threads : 1);
+}
+
+/*
+ * Works through the worker's own items, then steals from the others in turn
+ * until a whole pass finds nothing left.  Stolen items go through the
+ * thief's own range, so they can be stolen again in turn.
+ */
+static void pool_work(pool_t pool, int index)
+{
+	struct pool_worker_struct *worker = pool->workers + index;
+	int item, i;
+
+
+	do
+	{
+		while(pool_take(worker, &item))
+		{
+			pool->function(pool->blob, item, item + 1);
+		}
+
+		for(i = 1; i < pool->threads && !pool_steal(worker, pool->workers + (index + i) % pool->threads); i++)
+			;
+	}
+	while(i < pool->threads);
+}
+
+static void *pool_worker(void *blob)
+{
+	struct pool_worker_struct *worker = (struct pool_worker_struct *) blob;
+	pool_t pool = worker->pool;
+// workers are all started before the first run
+	unsigned int generation = 0;
+
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for(;;)
+	{
+		while(!pool->stop && pool->generation == generation)
+		{
+			pthread_cond_wait(&pool->start, &pool->mutex);
+		}
+		if(pool->stop) break;
+
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+
+		pool_work(pool, worker->index);
+
+		pthread_mutex_lock(&pool->mutex);
+		if(!--pool->busy)
+		{
+			pthread_cond_signal(&pool->done);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return(0);
+}
+
+
+
+#if defined(TEST)
+
+#include <sched.h>
+#include <stdio.h>
+
+static int assert_errors = 0;
+
+#define ASSERT(test)	{if(!(test)) {fprintf(stderr, "%s:%d: test \"%s\" failed\n", __FILE__, __LINE__, #test); assert_errors++;}}
+
+#define TEST_ITEMS		10007
+#define TEST_RUNS		100
+#define TEST_SLOW_ITEMS	64
+
+static int test_items[TEST_ITEMS];
+static pthread_t test_owners[TEST_ITEMS];
+// the calling thread, and whether another has taken an item of its share
+static pthread_t test_caller;
+static atomic_int test_stolen;
+
+static void test_function(void *blob, int first, int last)
+{
+	int i;
+
+
+	for(i = first; i < last; i++)
+	{
+		test_items[i] += *(int *) blob;
+		test_owners[i] = pthread_self();
+	}
+}
+
+// the first share is stuck on the calling thread until another thread takes
+// one of its items, which it can only have done by stealing
+static void test_slow_function(void *blob, int first, int last)
+{
+	int i;
+
+
+	for(i = first; i < last; i++)
+	{
+		if(i < TEST_SLOW_ITEMS && !pthread_equal(pthread_self(), test_caller))
+		{
+			atomic_store(&test_stolen, 1);
+		}
+		else if(i < TEST_SLOW_ITEMS && *(int *) blob > 1)
+		{
+			while(!atomic_load(&test_stolen)) sched_yield();
+		}
+		test_owners[i] = pthread_self();
+	}
+}
+
+int main(void)
+{
+	static const int threads[] = { 1, 2, 3, 8, 0 };
+	pool_t p = 0;
+	int i, j, run, count, increment = 1, stolen;
+
+
+	ASSERT(pool_threads(0) == 1);
+
+	for(i = 0; i < (int) ARRAY_SIZE(threads); i++)
+	{
+		p = pool(threads[i]);
+		ASSERT(p);
+		ASSERT(pool_threads(p) >= 1);
+		if(threads[i] > 0) ASSERT(pool_threads(p) == threads[i]);
+
+// every item is done once per run, whatever the count
+		for(run = 0; run < TEST_RUNS; run++)
+		{
+			count = run ? random() % TEST_ITEMS : 0;
+			bzero(test_items, sizeof(test_items));
+
+			pool_run(p, test_function, &increment, count);
+
+			for(j = 0; j < TEST_ITEMS; j++)
+			{
+				ASSERT(test_items[j] == (j < count));
+if(assert_errors) fprintf(stderr, "threads=%d, count=%d, test_items[%d]=%d\n", pool_threads(p), count, j, test_items[j]);
+				if(assert_errors) break;
+			}
+		}
+
+// idle threads take over the slow share's items
+		test_caller = pthread_self();
+		atomic_store(&test_stolen, 0);
+		count = pool_threads(p);
+		pool_run(p, test_slow_function, &count, TEST_SLOW_ITEMS * count);
+		for(stolen = 0, j = 0; j < TEST_SLOW_ITEMS; j++)
+		{
+			if(!pthread_equal(test_owners[j], pthread_self())) stolen++;
+		}
+		ASSERT(count == 1 ? !stolen : stolen > 0);
+if(assert_errors) fprintf(stderr, "threads=%d, stolen=%d\n", pool_threads(p), stolen);
+
+		pool_dlete(p);
+	}
+
+	return(assert_errors);
+}
+
+#endif
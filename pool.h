@@ -0,0 +1,59 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+/*
+ * pool is a fixed set of worker threads that share out a range of items
+ *
+ * pool_run splits items 0 to count-1 into one contiguous share per
+ * thread, and a thread that finishes its own share steals the back half of
+ * what is left of another's, so a slow share is finished by whichever
+ * threads are idle.  Each item is still done by exactly one thread, in
+ * runs of one, and pool_run returns when every item is done.  The calling
+ * thread starts on the first share itself.  Runs must not overlap.
+ */
+
+#if !defined(POOL)
+#define POOL
+
+typedef struct pool_struct *pool_t;
+
+// handles items first up to but not including last
+typedef void (*pool_function_t)(void *blob, int first, int last);
+
+// threads of 0 or less is one per online CPU
+pool_t pool(int threads);
+void pool_dlete(pool_t pool);
+
+void pool_run(pool_t pool, pool_function_t function, void *blob, int count);
+int pool_threads(pool_t pool);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resample.h"
+
+#define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
+
+// the filter spans this many samples at the lower rate, which sets the transition band
+#define RESAMPLE_SPAN		64
+#define RESAMPLE_FILTER_MAX	(1 << 20)
+#define RESAMPLE_BLOCK		1024
+#define RESAMPLE_Q			15
+
+// phase p of the filter is taps long, reversed so it runs forwards
+// through buffer, which is taps - 1 of history then the block; position
+// is the next output in input samples times up, from the block start
+struct resample_struct
+{
+	int up, down;
+	int taps;
+	signed short *filter;
+	signed short *buffer;
+	long long position;
+};
+
+
+static int resample_gcd(int a, int b);
+resample_t resample(int input_rate, int output_rate);
+void resample_dlete(resample_t resample);
+int resample_run(resample_t resample, signed short *output, int output_size, const signed short *input, int input_count);
+int resample_size(resample_t resample, int input_count);
+
+
+
+static int resample_gcd(int a, int b)
+{
+	int t;
+
+
+	while(b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return(a);
+}
+
+resample_t resample(int input_rate, int output_rate)
+{
+	resample_t resample = 0;
+	double *prototype = 0, x, cutoff, sum;
+	int gcd, slowest, length, i, p, j, q;
+
+
+	if(input_rate <= 0 || output_rate <= 0) return(0);
+
+	gcd = resample_gcd(input_rate, output_rate);
+
+	resample = (resample_t) calloc(1, sizeof(struct resample_struct));
+	resample->up = output_rate / gcd;
+	resample->down = input_rate / gcd;
+
+// the prototype runs at input_rate * up, and cuts off at the lower Nyquist
+	slowest = resample->up > resample->down ? resample->up : resample->down;
+	resample->taps = (int) (((long long) RESAMPLE_SPAN * slowest + resample->up - 1) / resample->up);
+
+	if((long long) resample->taps * resample->up > RESAMPLE_FILTER_MAX)
+	{
+		resample_dlete(resample);
+		return(0);
+	}
+
+	length = resample->taps * resample->up;
+	cutoff = 0.5 / slowest;
+	prototype = (double *) calloc(length, sizeof(double));
+
+	for(sum = 0, i = 0; i < length; i++)
+	{
+		x = 2.0 * cutoff * (i - (length - 1) / 2.0);
+		prototype[i] = x ? sin(M_PI * x) / (M_PI * x) : 1.0;
+		prototype[i] *= 0.42 - 0.5 * cos((2.0 * M_PI * (i + 0.5)) / length) + 0.08 * cos((4.0 * M_PI * (i + 0.5)) / length);
+		sum += prototype[i];
+	}
+
+// unity gain at DC for every phase
+	resample->filter = (signed short *) calloc(length, sizeof(signed short));
+
+	for(p = 0; p < resample->up; p++)
+	{
+		for(j = 0; j < resample->taps; j++)
+		{
+			q = (int) lrint(prototype[p + j * resample->up] * resample->up * (1 << RESAMPLE_Q) / sum);
+			if(q > 0x7FFF) q = 0x7FFF;
+			if(q < -0x8000) q = -0x8000;
+			resample->filter[p * resample->taps + resample->taps - 1 - j] = (signed short) q;
+		}
+	}
+
+	free(prototype);
+
+	resample->buffer = (signed short *) calloc(resample->taps - 1 + RESAMPLE_BLOCK, sizeof(signed short));
+
+	return(resample);
+}
+
+void resample_dlete(resample_t resample)
+{
+	if(!resample) return;
+
+	if(resample->buffer)
+	{
+		free(resample->buffer);
+		resample->buffer = 0;
+	}
+
+	if(resample->filter)
+	{
+		free(resample->filter);
+		resample->filter = 0;
+	}
+
+	free(resample);
+}
+
+int resample_run(resample_t resample, signed short *output, int output_size, const signed short *input, int input_count)
+{
+	const signed short *filter, *history;
+	int count, n, j, sum, outputs = 0;
+
+
+	while(input_count > 0)
+	{
+		count = input_count < RESAMPLE_BLOCK ? input_count : RESAMPLE_BLOCK;
+		memcpy(resample->buffer + resample->taps - 1, input, count * sizeof(signed short));
+
+		for(; (n = (int) (resample->position / resample->up)) < count; resample->position += resample->down)
+		{
+			if(outputs >= output_size) continue;
+
+			filter = resample->filter + (resample->position % resample->up) * resample->taps;
+			history = resample->buffer + n;
+
+// plain enough for the compiler to vectorise
+			for(sum = 0, j = 0; j < resample->taps; j++)
+			{
+				sum += filter[j] * history[j];
+			}
+
+			sum = (sum + (1 << (RESAMPLE_Q - 1))) >> RESAMPLE_Q;
+			output[outputs++] = sum > 0x7FFF ? 0x7FFF : sum < -0x8000 ? -0x8000 : sum;
+		}
+
+		resample->position -= (long long) count * resample->up;
+		memmove(resample->buffer, resample->buffer + count, (resample->taps - 1) * sizeof(signed short));
+
+		input += count;
+		input_count -= count;
+	}
+
+	return(outputs);
+}
+
+int resample_size(resample_t resample, int input_count)
+{
+	return((int) (((long long) input_count * resample->up) / resample->down + 1));
+}
+
+
+
+#if defined(TEST)
+
+#include <stdio.h>
+
+static int assert_errors = 0;
+
+#define ASSERT(test)	{if(!(test)) {fprintf(stderr, "%s:%d: test \"%s\" failed\n", __FILE__, __LINE__, #test); assert_errors++;}}
+
+#define TEST_OUTPUT_RATE	6400
+#define TEST_SECONDS		2
+#define TEST_INPUT_MAX		(48000 * TEST_SECONDS)
+#define TEST_OUTPUT_MAX		(TEST_OUTPUT_RATE * TEST_SECONDS + 1)
+
+static signed short test_input[TEST_INPUT_MAX];
+static signed short test_output[TEST_OUTPUT_MAX], test_pieces[TEST_OUTPUT_MAX];
+
+static void test_tone(int rate, double hz)
+{
+	int i;
+
+
+	for(i = 0; i < TEST_SECONDS * rate; i++)
+	{
+		test_input[i] = (signed short) lrint(10000 * cos((2.0 * M_PI * hz * i) / rate));
+	}
+}
+
+// rms of the second half, once the filter is full
+static double test_rms(const signed short *output, int count)
+{
+	double sum = 0;
+	int i;
+
+
+	for(i = count / 2; i < count; i++)
+	{
+		sum += (double) output[i] * output[i];
+	}
+
+	return(sqrt(sum / (count - count / 2)));
+}
+
+int main(void)
+{
+	static const int rates[] = { 8000, 16000, 32000, 44100, 48000 };
+	resample_t r = 0;
+	int i, j, count, pieces, piece, input_count;
+	double rms;
+
+
+	ASSERT(!resample(0, TEST_OUTPUT_RATE));
+	ASSERT(!resample(48000, -1));
+	ASSERT(!resample(1000003, 1000033));
+
+	for(i = 0; i < (int) ARRAY_SIZE(rates); i++)
+	{
+		input_count = TEST_SECONDS * rates[i];
+
+// fed in odd pieces it gives exactly what it gives all at once
+		test_tone(rates[i], 1000);
+		r = resample(rates[i], TEST_OUTPUT_RATE);
+		ASSERT(r);
+		count = resample_run(r, test_output, TEST_OUTPUT_MAX, test_input, input_count);
+		ASSERT(count == TEST_OUTPUT_RATE * TEST_SECONDS);
+		ASSERT(resample_size(r, input_count) >= count);
+		resample_dlete(r);
+
+		r = resample(rates[i], TEST_OUTPUT_RATE);
+		for(pieces = 0, j = 0; j < input_count; j += piece)
+		{
+			piece = 1 + random() % 3000;
+			if(piece > input_count - j) piece = input_count - j;
+			pieces += resample_run(r, test_pieces + pieces, TEST_OUTPUT_MAX - pieces, test_input + j, piece);
+		}
+		ASSERT(pieces == count);
+		ASSERT(!memcmp(test_output, test_pieces, count * sizeof(signed short)));
+		resample_dlete(r);
+
+// in band passes, within 0.5dB
+		rms = test_rms(test_output, count);
+		ASSERT(rms > 10000 * M_SQRT1_2 * 0.944 && rms < 10000 * M_SQRT1_2 * 1.059);
+if(assert_errors) fprintf(stderr, "rate=%d, in band rms=%f\n", rates[i], rms);
+
+// and what would alias, just under the input Nyquist, is 40dB down
+		test_tone(rates[i], rates[i] / 2 - 200);
+		r = resample(rates[i], TEST_OUTPUT_RATE);
+		count = resample_run(r, test_output, TEST_OUTPUT_MAX, test_input, input_count);
+		rms = test_rms(test_output, count);
+		ASSERT(rms < 10000 * M_SQRT1_2 / 100);
+if(assert_errors) fprintf(stderr, "rate=%d, aliased rms=%f\n", rates[i], rms);
+		resample_dlete(r);
+
+		if(assert_errors) break;
+	}
+
+	return(assert_errors);
+}
+
+#endif
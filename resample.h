@@ -0,0 +1,57 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+/*
+ * resample converts 16 bit audio between two rates with a rational
+ * polyphase filter
+ *
+ * The rates reduce to up/down, and each output is a dot product of one
+ * phase of a windowed sinc with the latest input, so nothing above the
+ * lower of the two Nyquist frequencies is aliased down.  The filter is
+ * Q15 and the input history is kept between calls, so a stream can be
+ * fed in pieces of any size with the same result as all at once.
+ */
+
+#if !defined(RESAMPLE)
+#define RESAMPLE
+
+typedef struct resample_struct *resample_t;
+
+// 0 if the ratio needs too long a filter
+resample_t resample(int input_rate, int output_rate);
+void resample_dlete(resample_t resample);
+
+// outputs beyond output_size are lost, resample_size says how many to allow for
+int resample_run(resample_t resample, signed short *output, int output_size, const signed short *input, int input_count);
+int resample_size(resample_t resample, int input_count);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+#define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
+
+#define RING_DEPTH_MAX		(1 << 30)
+#define RING_LINE			64
+
+// head and tail count samples ever written and read, wrapping, and
+// each end writes only its own cache line
+struct ring_struct
+{
+	_Alignas(RING_LINE) signed short *samples;
+	int depth;
+	unsigned int mask;
+
+	_Alignas(RING_LINE) atomic_uint head;
+	atomic_ulong overruns, dropped;
+
+	_Alignas(RING_LINE) atomic_uint tail;
+};
+
+
+ring_t ring(int depth);
+int ring_depth(ring_t ring);
+void ring_dlete(ring_t ring);
+unsigned long ring_dropped(ring_t ring);
+unsigned long ring_overruns(ring_t ring);
+int ring_read(ring_t ring, signed short *output, int output_size);
+int ring_used(ring_t ring);
+int ring_write(ring_t ring, const signed short *input, int input_count);
+
+
+
+ring_t ring(int depth)
+{
+	ring_t ring = 0;
+	int size;
+
+
+	if(depth <= 0 || depth > RING_DEPTH_MAX) return(0);
+
+	for(size = 1; size < depth; size <<= 1)
+		;
+
+	ring = (ring_t) aligned_alloc(RING_LINE, sizeof(struct ring_struct));
+	if(!ring) return(0);
+
+	bzero(ring, sizeof(struct ring_struct));
+	ring->depth = size;
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->overruns, 0);
+	atomic_init(&ring->dropped, 0);
+
+	ring->samples = (signed short *) calloc(size, sizeof(signed short));
+	if(!ring->samples)
+	{
+		ring_dlete(ring);
+		return(0);
+	}
+
+	return(ring);
+}
+
+int ring_depth(ring_t ring)
+{
+	return(ring->depth);
+}
+
+void ring_dlete(ring_t ring)
+{
+	if(!ring) return;
+
+	if(ring->samples)
+	{
+		free(ring->samples);
+		ring->samples = 0;
+	}
+
+	free(ring);
+}
+
+unsigned long ring_dropped(ring_t ring)
+{
+	return(atomic_load_explicit(&ring->dropped, memory_order_relaxed));
+}
+
+unsigned long ring_overruns(ring_t ring)
+{
+	return(atomic_load_explicit(&ring->overruns, memory_order_relaxed));
+}
+
+// consumer only
+int ring_read(ring_t ring, signed short *output, int output_size)
+{
+	unsigned int head, tail, first;
+	int count, part;
+
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	count = (int) (head - tail);
+	if(count > output_size) count = output_size;
+	if(count <= 0) return(0);
+
+	first = tail & ring->mask;
+	part = ring->depth - (int) first;
+	if(part > count) part = count;
+
+	memcpy(output, ring->samples + first, part * sizeof(signed short));
+	memcpy(output + part, ring->samples, (count - part) * sizeof(signed short));
+
+	atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+
+	return(count);
+}
+
+int ring_used(ring_t ring)
+{
+	return((int) (atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_acquire)));
+}
+
+// producer only, returns input_count, or 0 if it was dropped
+int ring_write(ring_t ring, const signed short *input, int input_count)
+{
+	unsigned int head, tail, first;
+	int part;
+
+
+	if(input_count <= 0) return(0);
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if(input_count > ring->depth - (int) (head - tail))
+	{
+		atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&ring->dropped, input_count, memory_order_relaxed);
+		return(0);
+	}
+
+	first = head & ring->mask;
+	part = ring->depth - (int) first;
+	if(part > input_count) part = input_count;
+
+	memcpy(ring->samples + first, input, part * sizeof(signed short));
+	memcpy(ring->samples, input + part, (input_count - part) * sizeof(signed short));
+
+	atomic_store_explicit(&ring->head, head + input_count, memory_order_release);
+
+	return(input_count);
+}
+
+
+
+#if defined(TEST)
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+static int assert_errors = 0;
+
+#define ASSERT(test)	{if(!(test)) {fprintf(stderr, "%s:%d: test \"%s\" failed\n", __FILE__, __LINE__, #test); assert_errors++;}}
+
+#define TEST_DEPTH		1000
+#define TEST_SAMPLES	10000000
+
+// writes a count up, in odd sized pieces, waiting rather than dropping
+static void *test_producer(void *blob)
+{
+	ring_t r = (ring_t) blob;
+	signed short input[97];
+	int i, count, sent = 0;
+
+
+	while(sent < TEST_SAMPLES)
+	{
+		count = 1 + random() % ARRAY_SIZE(input);
+		if(count > TEST_SAMPLES - sent) count = TEST_SAMPLES - sent;
+
+		for(i = 0; i < count; i++)
+		{
+			input[i] = (signed short) (sent + i);
+		}
+
+		while(!ring_write(r, input, count))
+		{
+			sched_yield();
+		}
+
+		sent += count;
+	}
+
+	return(0);
+}
+
+int main(void)
+{
+	signed short input[TEST_DEPTH], output[2 * TEST_DEPTH];
+	pthread_t producer;
+	ring_t r = 0;
+	int i, count, received;
+
+
+	ASSERT(!ring(0));
+	ASSERT(!ring(-1));
+
+	r = ring(TEST_DEPTH);
+	ASSERT(r);
+	ASSERT(ring_depth(r) == 1024);
+	ASSERT(!ring_used(r));
+	ASSERT(!ring_read(r, output, ARRAY_SIZE(output)));
+
+	for(i = 0; i < (int) ARRAY_SIZE(input); i++)
+	{
+		input[i] = (signed short) i;
+	}
+
+// whole writes go in or are dropped and counted, never a part of one
+	ASSERT(ring_write(r, input, 600) == 600);
+	ASSERT(!ring_write(r, input, 600));
+	ASSERT(ring_overruns(r) == 1);
+	ASSERT(ring_dropped(r) == 600);
+	ASSERT(ring_write(r, input, 424) == 424);
+	ASSERT(ring_used(r) == 1024);
+	ASSERT(!ring_write(r, input, 1));
+	ASSERT(ring_overruns(r) == 2);
+	ASSERT(ring_dropped(r) == 601);
+
+	ASSERT(ring_read(r, output, 500) == 500);
+	ASSERT(!memcmp(output, input, 500 * sizeof(signed short)));
+	ASSERT(ring_read(r, output, ARRAY_SIZE(output)) == 524);
+	ASSERT(!memcmp(output, input + 500, 100 * sizeof(signed short)));
+	ASSERT(!memcmp(output + 100, input, 424 * sizeof(signed short)));
+
+// and across the end of the buffer
+	ASSERT(ring_write(r, input, 1000) == 1000);
+	ASSERT(ring_read(r, output, ARRAY_SIZE(output)) == 1000);
+	ASSERT(!memcmp(output, input, 1000 * sizeof(signed short)));
+	ASSERT(!ring_used(r));
+
+	ring_dlete(r);
+
+// one thread each end, everything arrives once and in order
+	r = ring(TEST_DEPTH);
+	pthread_create(&producer, 0, test_producer, r);
+
+	for(received = 0; received < TEST_SAMPLES; received += count)
+	{
+		count = ring_read(r, output, 1 + random() % ARRAY_SIZE(output));
+		if(!count) sched_yield();
+
+		for(i = 0; i < count; i++)
+		{
+			if(output[i] != (signed short) (received + i))
+			{
+				ASSERT(output[i] == (signed short) (received + i));
+if(assert_errors) fprintf(stderr, "received=%d, output[%d]=%d\n", received, i, output[i]);
+				received = TEST_SAMPLES;
+				break;
+			}
+		}
+	}
+
+	pthread_join(producer, 0);
+	ASSERT(!ring_used(r));
+
+	ring_dlete(r);
+
+	return(assert_errors);
+}
+
+#endif
@@ -0,0 +1,689 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
+
+#define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
+
+struct simd_struct
+{
+	void (*above)(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+	void (*above_each)(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+	void (*butterflies)(int *lo, int *hi, const int *twiddles, int bits, int count);
+	void (*fir)(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+	void (*sliding)(float *state, const float *twiddles, float real, float imag, int bins);
+};
+
+
+void simd_above(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+static void simd_above_scalar(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+void simd_above_each(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+static void simd_above_each_scalar(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+void simd_butterflies(int *lo, int *hi, const int *twiddles, int bits, int count);
+static void simd_butterflies_scalar(int *lo, int *hi, const int *twiddles, int bits, int count);
+simd_t simd(void);
+void *simd_calloc(size_t count, size_t size);
+void simd_fir(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+static void simd_fir_scalar(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+int simd_set(simd_t variant);
+void simd_sliding(float *state, const float *twiddles, float real, float imag, int bins);
+static void simd_sliding_scalar(float *state, const float *twiddles, float real, float imag, int bins);
+simd_t simd_start(void);
+int simd_supported(simd_t variant);
+
+#if defined(SIMD_X86)
+static void simd_above_avx2(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+static void simd_above_sse2(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+static void simd_above_each_avx2(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+static void simd_above_each_sse2(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+static void simd_butterflies_avx2(int *lo, int *hi, const int *twiddles, int bits, int count);
+static void simd_butterflies_sse2(int *lo, int *hi, const int *twiddles, int bits, int count);
+static inline __m128i simd_mul_epi32_sse2(__m128i a, __m128i b);
+static void simd_fir_avx2(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+static void simd_fir_sse2(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+static void simd_sliding_avx2(float *state, const float *twiddles, float real, float imag, int bins);
+static void simd_sliding_sse2(float *state, const float *twiddles, float real, float imag, int bins);
+#endif
+
+static const struct simd_struct simd_variants[SIMD_COUNT] =
+{
+	{ simd_above_scalar, simd_above_each_scalar, simd_butterflies_scalar, simd_fir_scalar, simd_sliding_scalar },
+#if defined(SIMD_X86)
+	{ simd_above_sse2, simd_above_each_sse2, simd_butterflies_sse2, simd_fir_sse2, simd_sliding_sse2 },
+	{ simd_above_avx2, simd_above_each_avx2, simd_butterflies_avx2, simd_fir_avx2, simd_sliding_avx2 },
+#else
+	{ simd_above_scalar, simd_above_each_scalar, simd_butterflies_scalar, simd_fir_scalar, simd_sliding_scalar },
+	{ simd_above_scalar, simd_above_each_scalar, simd_butterflies_scalar, simd_fir_scalar, simd_sliding_scalar },
+#endif
+};
+
+static const struct simd_struct *simd_variant = simd_variants + SIMD_SCALAR;
+
+
+
+void simd_above(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count)
+{
+	simd_variant->above(bits, input, threshold, count);
+}
+
+static void simd_above_scalar(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count)
+{
+	int i;
+
+
+	if(count <= 0) return;
+
+	bzero(bits, ((count + 63) >> 6) * sizeof(*bits));
+
+	for(i = 0; i < count; i++)
+	{
+		bits[i >> 6] |= (unsigned long long) (input[i] > threshold) << (i & 63);
+	}
+}
+
+void simd_above_each(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count)
+{
+	simd_variant->above_each(bits, input, thresholds, count);
+}
+
+static void simd_above_each_scalar(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count)
+{
+	int i;
+
+
+	if(count <= 0) return;
+
+	bzero(bits, ((count + 63) >> 6) * sizeof(*bits));
+
+	for(i = 0; i < count; i++)
+	{
+		bits[i >> 6] |= (unsigned long long) (input[i] > thresholds[i]) << (i & 63);
+	}
+}
+
+void simd_butterflies(int *lo, int *hi, const int *twiddles, int bits, int count)
+{
+	simd_variant->butterflies(lo, hi, twiddles, bits, count);
+}
+
+// only the low 32 bits of each sum are kept, which the vector versions get
+// from a logical shift of the same 64 bit products
+static void simd_butterflies_scalar(int *lo, int *hi, const int *twiddles, int bits, int count)
+{
+	long long real, imag, half = 1LL << (bits - 1);
+	int k;
+
+
+	for(k = 0; k < count; k++)
+	{
+		real = ((long long) hi[2 * k] * twiddles[2 * k] - (long long) hi[2 * k + 1] * twiddles[2 * k + 1] + half) >> bits;
+		imag = ((long long) hi[2 * k] * twiddles[2 * k + 1] + (long long) hi[2 * k + 1] * twiddles[2 * k] + half) >> bits;
+
+		hi[2 * k] = lo[2 * k] - real;
+		hi[2 * k + 1] = lo[2 * k + 1] - imag;
+		lo[2 * k] += real;
+		lo[2 * k + 1] += imag;
+	}
+}
+
+simd_t simd(void)
+{
+	return((simd_t) (simd_variant - simd_variants));
+}
+
+// zeroed and cache line aligned, for tables the kernels stream through, free with free()
+void *simd_calloc(size_t count, size_t size)
+{
+	void *ret = 0;
+
+
+	size = (count * size + SIMD_ALIGN - 1) & ~(SIMD_ALIGN - 1);
+	if(!size) size = SIMD_ALIGN;
+
+	ret = aligned_alloc(SIMD_ALIGN, size);
+	if(ret) memset(ret, 0, size);
+
+	return(ret);
+}
+
+void simd_fir(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count)
+{
+	simd_variant->fir(output, filter, stride, inputs, taps, count);
+}
+
+// sums wrap like the vector versions, so keep them inside 32 bits
+static void simd_fir_scalar(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count)
+{
+	unsigned int sum;
+	int i, t;
+
+
+	for(i = 0; i < count; i++)
+	{
+		sum = 0;
+		for(t = 0; t < taps; t++)
+		{
+			sum += (unsigned int) (filter[t * stride + i] * inputs[t][i]);
+		}
+		output[i] = (int) sum;
+	}
+}
+
+// force a variant, which must be supported by this CPU
+int simd_set(simd_t variant)
+{
+	if(!simd_supported(variant)) return(-1);
+
+	simd_variant = simd_variants + variant;
+
+	return(0);
+}
+
+void simd_sliding(float *state, const float *twiddles, float real, float imag, int bins)
+{
+	simd_variant->sliding(state, twiddles, real, imag, bins);
+}
+
+// products are rounded before they're summed, as they are in the vector versions (no FMA)
+static void simd_sliding_scalar(float *state, const float *twiddles, float real, float imag, int bins)
+{
+	float r, i;
+	int k;
+
+
+	for(k = 0; k < bins; k++)
+	{
+		r = state[2 * k] + real;
+		i = state[2 * k + 1] + imag;
+		state[2 * k] = r * twiddles[2 * k] - i * twiddles[2 * k + 1];
+		state[2 * k + 1] = r * twiddles[2 * k + 1] + i * twiddles[2 * k];
+	}
+}
+
+// pick the best variant this CPU supports
+simd_t simd_start(void)
+{
+	simd_t variant;
+
+
+	for(variant = SIMD_COUNT - 1; variant > SIMD_SCALAR && !simd_supported(variant); variant--)
+		;
+
+	simd_set(variant);
+
+	return(variant);
+}
+
+int simd_supported(simd_t variant)
+{
+	switch(variant)
+	{
+	case SIMD_SCALAR:
+		return(1);
+
+#if defined(SIMD_X86)
+	case SIMD_SSE2:
+		__builtin_cpu_init();
+		return(__builtin_cpu_supports("sse2"));
+
+	case SIMD_AVX2:
+		__builtin_cpu_init();
+		return(__builtin_cpu_supports("avx2"));
+#endif
+
+	default:
+		break;
+	}
+
+	return(0);
+}
+
+
+#if defined(SIMD_X86)
+
+// bytes compare signed, so both sides are offset by 128 to compare unsigned
+__attribute__((target("avx2")))
+static void simd_above_avx2(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count)
+{
+	__m256i offset = _mm256_set1_epi8((char) 0x80), t = _mm256_set1_epi8((char) (threshold ^ 0x80));
+	unsigned int low, high;
+	int i;
+
+
+	for(i = 0; i + 64 <= count; i += 64)
+	{
+		low = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (input + i)), offset), t));
+		high = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (input + i + 32)), offset), t));
+		bits[i >> 6] = (unsigned long long) high << 32 | low;
+	}
+
+	simd_above_scalar(bits + (i >> 6), input + i, threshold, count - i);
+}
+
+__attribute__((target("sse2")))
+static void simd_above_sse2(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count)
+{
+	__m128i offset = _mm_set1_epi8((char) 0x80), t = _mm_set1_epi8((char) (threshold ^ 0x80));
+	unsigned long long word;
+	int i, j;
+
+
+	for(i = 0; i + 64 <= count; i += 64)
+	{
+		for(word = 0, j = 0; j < 64; j += 16)
+		{
+			word |= (unsigned long long) _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (input + i + j)), offset), t)) << j;
+		}
+		bits[i >> 6] = word;
+	}
+
+	simd_above_scalar(bits + (i >> 6), input + i, threshold, count - i);
+}
+
+__attribute__((target("avx2")))
+static void simd_above_each_avx2(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count)
+{
+	__m256i offset = _mm256_set1_epi8((char) 0x80);
+	unsigned int low, high;
+	int i;
+
+
+	for(i = 0; i + 64 <= count; i += 64)
+	{
+		low = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (input + i)), offset),
+				_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (thresholds + i)), offset)));
+		high = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (input + i + 32)), offset),
+				_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (thresholds + i + 32)), offset)));
+		bits[i >> 6] = (unsigned long long) high << 32 | low;
+	}
+
+	simd_above_each_scalar(bits + (i >> 6), input + i, thresholds + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void simd_above_each_sse2(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count)
+{
+	__m128i offset = _mm_set1_epi8((char) 0x80);
+	unsigned long long word;
+	int i, j;
+
+
+	for(i = 0; i + 64 <= count; i += 64)
+	{
+		for(word = 0, j = 0; j < 64; j += 16)
+		{
+			word |= (unsigned long long) _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (input + i + j)), offset),
+					_mm_xor_si128(_mm_loadu_si128((const __m128i *) (thresholds + i + j)), offset))) << j;
+		}
+		bits[i >> 6] = word;
+	}
+
+	simd_above_each_scalar(bits + (i >> 6), input + i, thresholds + i, count - i);
+}
+
+// _mm256_mul_epi32 multiplies the even ints, the real parts, sign extended
+// to 64 bits, and the imaginary parts are shifted down into them
+__attribute__((target("avx2")))
+static void simd_butterflies_avx2(int *lo, int *hi, const int *twiddles, int bits, int count)
+{
+	__m256i a, h, w, h_odd, w_odd, real, imag, t;
+	__m256i half = _mm256_set1_epi64x(1LL << (bits - 1));
+	__m128i shift = _mm_cvtsi32_si128(bits);
+	int k;
+
+
+	for(k = 0; k + 4 <= count; k += 4)
+	{
+		a = _mm256_loadu_si256((const __m256i *) (lo + 2 * k));
+		h = _mm256_loadu_si256((const __m256i *) (hi + 2 * k));
+		w = _mm256_loadu_si256((const __m256i *) (twiddles + 2 * k));
+		h_odd = _mm256_srli_epi64(h, 32);
+		w_odd = _mm256_srli_epi64(w, 32);
+
+		real = _mm256_srl_epi64(_mm256_add_epi64(_mm256_sub_epi64(_mm256_mul_epi32(h, w), _mm256_mul_epi32(h_odd, w_odd)), half), shift);
+		imag = _mm256_srl_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epi32(h, w_odd), _mm256_mul_epi32(h_odd, w)), half), shift);
+		t = _mm256_blend_epi32(real, _mm256_slli_epi64(imag, 32), 0xAA);
+
+		_mm256_storeu_si256((__m256i *) (hi + 2 * k), _mm256_sub_epi32(a, t));
+		_mm256_storeu_si256((__m256i *) (lo + 2 * k), _mm256_add_epi32(a, t));
+	}
+
+	simd_butterflies_scalar(lo + 2 * k, hi + 2 * k, twiddles + 2 * k, bits, count - k);
+}
+
+// as the AVX2 version, with the signed multiply made from the unsigned one
+__attribute__((target("sse2")))
+static void simd_butterflies_sse2(int *lo, int *hi, const int *twiddles, int bits, int count)
+{
+	__m128i a, h, w, h_odd, w_odd, real, imag, t;
+	__m128i half = _mm_set1_epi64x(1LL << (bits - 1)), low = _mm_set1_epi64x(0xFFFFFFFFLL);
+	__m128i shift = _mm_cvtsi32_si128(bits);
+	int k;
+
+
+	for(k = 0; k + 2 <= count; k += 2)
+	{
+		a = _mm_loadu_si128((const __m128i *) (lo + 2 * k));
+		h = _mm_loadu_si128((const __m128i *) (hi + 2 * k));
+		w = _mm_loadu_si128((const __m128i *) (twiddles + 2 * k));
+		h_odd = _mm_srli_epi64(h, 32);
+		w_odd = _mm_srli_epi64(w, 32);
+
+		real = _mm_srl_epi64(_mm_add_epi64(_mm_sub_epi64(simd_mul_epi32_sse2(h, w), simd_mul_epi32_sse2(h_odd, w_odd)), half), shift);
+		imag = _mm_srl_epi64(_mm_add_epi64(_mm_add_epi64(simd_mul_epi32_sse2(h, w_odd), simd_mul_epi32_sse2(h_odd, w)), half), shift);
+		t = _mm_or_si128(_mm_and_si128(real, low), _mm_slli_epi64(imag, 32));
+
+		_mm_storeu_si128((__m128i *) (hi + 2 * k), _mm_sub_epi32(a, t));
+		_mm_storeu_si128((__m128i *) (lo + 2 * k), _mm_add_epi32(a, t));
+	}
+
+	simd_butterflies_scalar(lo + 2 * k, hi + 2 * k, twiddles + 2 * k, bits, count - k);
+}
+
+/*
+ * _mm_mul_epi32 is SSE4.1, so the even ints are multiplied unsigned and the
+ * top half corrected, taking b from it if a is negative and a if b is
+ */
+__attribute__((target("sse2")))
+static inline __m128i simd_mul_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i correction = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b), _mm_and_si128(_mm_srai_epi32(b, 31), a));
+
+
+	return(_mm_sub_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(correction, 32)));
+}
+
+__attribute__((target("avx2")))
+static void simd_fir_avx2(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count)
+{
+	__m256i sum;
+	int i, t;
+
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		sum = _mm256_setzero_si256();
+		for(t = 0; t < taps; t++)
+		{
+			sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(
+					_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (filter + t * stride + i))),
+					_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (inputs[t] + i)))));
+		}
+		_mm256_storeu_si256((__m256i *) (output + i), sum);
+	}
+
+	if(i < count)
+	{
+		const signed short *tails[taps];
+
+		for(t = 0; t < taps; t++)
+		{
+			tails[t] = inputs[t] + i;
+		}
+		simd_fir_scalar(output + i, filter + i, stride, tails, taps, count - i);
+	}
+}
+
+__attribute__((target("sse2")))
+static void simd_fir_sse2(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count)
+{
+	__m128i lo, hi, h, x, sum_lo, sum_hi;
+	int i, t;
+
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		sum_lo = _mm_setzero_si128();
+		sum_hi = _mm_setzero_si128();
+		for(t = 0; t < taps; t++)
+		{
+			h = _mm_loadu_si128((const __m128i *) (filter + t * stride + i));
+			x = _mm_loadu_si128((const __m128i *) (inputs[t] + i));
+			lo = _mm_mullo_epi16(h, x);
+			hi = _mm_mulhi_epi16(h, x);
+			sum_lo = _mm_add_epi32(sum_lo, _mm_unpacklo_epi16(lo, hi));
+			sum_hi = _mm_add_epi32(sum_hi, _mm_unpackhi_epi16(lo, hi));
+		}
+		_mm_storeu_si128((__m128i *) (output + i), sum_lo);
+		_mm_storeu_si128((__m128i *) (output + i + 4), sum_hi);
+	}
+
+	if(i < count)
+	{
+		const signed short *tails[taps];
+
+		for(t = 0; t < taps; t++)
+		{
+			tails[t] = inputs[t] + i;
+		}
+		simd_fir_scalar(output + i, filter + i, stride, tails, taps, count - i);
+	}
+}
+
+__attribute__((target("avx2")))
+static void simd_sliding_avx2(float *state, const float *twiddles, float real, float imag, int bins)
+{
+	__m256 a, w, x = _mm256_setr_ps(real, imag, real, imag, real, imag, real, imag);
+	__m256 sign = _mm256_setr_ps(-0.0, 0.0, -0.0, 0.0, -0.0, 0.0, -0.0, 0.0);
+	int k;
+
+
+	for(k = 0; k + 4 <= bins; k += 4)
+	{
+		a = _mm256_add_ps(_mm256_loadu_ps(state + 2 * k), x);
+		w = _mm256_loadu_ps(twiddles + 2 * k);
+		_mm256_storeu_ps(state + 2 * k, _mm256_add_ps(
+				_mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 0, 0)), w),
+				_mm256_xor_ps(sign, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 1, 1)), _mm256_shuffle_ps(w, w, _MM_SHUFFLE(2, 3, 0, 1))))));
+	}
+
+	simd_sliding_scalar(state + 2 * k, twiddles + 2 * k, real, imag, bins - k);
+}
+
+__attribute__((target("sse2")))
+static void simd_sliding_sse2(float *state, const float *twiddles, float real, float imag, int bins)
+{
+	__m128 a, w, x = _mm_setr_ps(real, imag, real, imag);
+	__m128 sign = _mm_setr_ps(-0.0, 0.0, -0.0, 0.0);
+	int k;
+
+
+	for(k = 0; k + 2 <= bins; k += 2)
+	{
+		a = _mm_add_ps(_mm_loadu_ps(state + 2 * k), x);
+		w = _mm_loadu_ps(twiddles + 2 * k);
+		_mm_storeu_ps(state + 2 * k, _mm_add_ps(
+				_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 0, 0)), w),
+				_mm_xor_ps(sign, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 1, 1)), _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 3, 0, 1))))));
+	}
+
+	simd_sliding_scalar(state + 2 * k, twiddles + 2 * k, real, imag, bins - k);
+}
+
+#endif
+
+
+
+#if defined(TEST)
+
+#include <stdio.h>
+
+static int assert_errors = 0;
+
+#define ASSERT(test)	{if(!(test)) {fprintf(stderr, "%s:%d: test \"%s\" failed\n", __FILE__, __LINE__, #test); assert_errors++;}}
+
+#define TEST_COUNT		300
+#define TEST_TAPS		8
+#define TEST_ROUNDS		100
+
+static signed short test_filter[TEST_TAPS * TEST_COUNT];
+static signed short test_input[TEST_TAPS][TEST_COUNT];
+static int test_fir[SIMD_COUNT][TEST_COUNT];
+static float test_state[SIMD_COUNT][2 * TEST_COUNT];
+static float test_twiddles[2 * TEST_COUNT];
+static unsigned char test_bytes[TEST_COUNT];
+static unsigned long long test_bits[SIMD_COUNT][(TEST_COUNT + 63) / 64];
+static unsigned char test_thresholds[TEST_COUNT];
+static unsigned long long test_bits_each[SIMD_COUNT][(TEST_COUNT + 63) / 64];
+static int test_lo[SIMD_COUNT][2 * TEST_COUNT];
+static int test_hi[SIMD_COUNT][2 * TEST_COUNT];
+static int test_twiddle_ints[2 * TEST_COUNT];
+
+// mostly random, with some full scale values to look for overflows
+static signed short test_short(int limit)
+{
+	switch(random() & 0x0F)
+	{
+	case 0: return(-limit - 1);
+	case 1: return(limit);
+	default: break;
+	}
+
+	return((signed short) (random() % (limit + 1)) * ((random() & 1) ? 1 : -1));
+}
+
+int main(void)
+{
+	const signed short *inputs[TEST_TAPS];
+	simd_t variant;
+	unsigned char threshold;
+	int round, i, t, count, offset;
+
+
+	ASSERT(simd_supported(SIMD_SCALAR));
+	ASSERT(simd_set(SIMD_COUNT));
+	ASSERT(simd_start() == simd());
+	ASSERT(!((size_t) simd_calloc(3, 7) & (SIMD_ALIGN - 1)));
+
+	for(round = 0; round < TEST_ROUNDS; round++)
+	{
+		count = random() % TEST_COUNT;
+		offset = random() & 1;
+
+// the filter and taps are sized like a polyphase filterbank, whose sums fit 32 bits
+		for(i = 0; i < TEST_TAPS * TEST_COUNT; i++)
+		{
+			test_filter[i] = test_short(0x0FFF);
+		}
+		for(t = 0; t < TEST_TAPS; t++)
+		{
+			for(i = 0; i < TEST_COUNT; i++)
+			{
+				test_input[t][i] = test_short(0x7FFF);
+			}
+			inputs[t] = test_input[t] + (random() & 1);
+		}
+		for(i = 0; i < 2 * TEST_COUNT; i++)
+		{
+			test_state[SIMD_SCALAR][i] = (random() % 2000000) - 1000000.0;
+			test_twiddles[i] = (random() % 2000001) / 1000000.0 - 1.0;
+		}
+// the bins of a 2^12 point transform of full scale input, and Q14 twiddles
+		for(i = 0; i < 2 * TEST_COUNT; i++)
+		{
+			test_lo[SIMD_SCALAR][i] = test_short(0x7FFF) * (1 << 12) + (random() & 0x0FFF);
+			test_hi[SIMD_SCALAR][i] = test_short(0x7FFF) * (1 << 12) + (random() & 0x0FFF);
+			test_twiddle_ints[i] = test_short(1 << 14) % ((1 << 14) + 1);
+		}
+		for(variant = SIMD_SCALAR + 1; variant < SIMD_COUNT; variant++)
+		{
+			memmove(test_state[variant], test_state[SIMD_SCALAR], sizeof(test_state[variant]));
+			memmove(test_lo[variant], test_lo[SIMD_SCALAR], sizeof(test_lo[variant]));
+			memmove(test_hi[variant], test_hi[SIMD_SCALAR], sizeof(test_hi[variant]));
+		}
+// levels either side of the threshold, and at both ends of the range
+		threshold = (round & 3) ? random() & 0xFF : (round & 4) ? 0xFF : 0;
+		for(i = 0; i < TEST_COUNT; i++)
+		{
+			test_bytes[i] = (random() & 1) ? threshold + (random() % 3) - 1 : random() & 0xFF;
+			test_thresholds[i] = (random() & 1) ? test_bytes[i] + (random() % 3) - 1 : random() & 0xFF;
+		}
+
+		for(variant = SIMD_SCALAR; variant < SIMD_COUNT; variant++)
+		{
+			if(!simd_supported(variant)) continue;
+
+			ASSERT(!simd_set(variant));
+			ASSERT(simd() == variant);
+
+			simd_fir(test_fir[variant], test_filter + offset, count, inputs, TEST_TAPS, count);
+			simd_sliding(test_state[variant], test_twiddles, 12345.5, -6789.25, count);
+			simd_sliding(test_state[variant], test_twiddles, -0.125, 1000000, count);
+			memset(test_bits[variant], 0xFF, sizeof(test_bits[variant]));
+			simd_above(test_bits[variant], test_bytes + offset, threshold, count);
+			memset(test_bits_each[variant], 0xFF, sizeof(test_bits_each[variant]));
+			simd_above_each(test_bits_each[variant], test_bytes + offset, test_thresholds, count);
+			simd_butterflies(test_lo[variant], test_hi[variant], test_twiddle_ints + 2 * offset, 14, count);
+		}
+
+// each variant matches the scalar reference exactly
+		for(variant = SIMD_SCALAR + 1; variant < SIMD_COUNT; variant++)
+		{
+			if(!simd_supported(variant)) continue;
+
+			ASSERT(!memcmp(test_fir[variant], test_fir[SIMD_SCALAR], count * sizeof(int)));
+			ASSERT(!memcmp(test_state[variant], test_state[SIMD_SCALAR], 2 * count * sizeof(float)));
+			ASSERT(!memcmp(test_bits[variant], test_bits[SIMD_SCALAR], ((count + 63) / 64) * sizeof(*test_bits[variant])));
+			ASSERT(!memcmp(test_bits_each[variant], test_bits_each[SIMD_SCALAR], ((count + 63) / 64) * sizeof(*test_bits_each[variant])));
+			ASSERT(!memcmp(test_lo[variant], test_lo[SIMD_SCALAR], sizeof(test_lo[variant])));
+			ASSERT(!memcmp(test_hi[variant], test_hi[SIMD_SCALAR], sizeof(test_hi[variant])));
+if(assert_errors) fprintf(stderr, "round %d, variant %d, count %d\n", round, variant, count);
+		}
+	}
+
+// the scalar bits are the plain comparison, with the tail of the last word clear
+	simd_set(SIMD_SCALAR);
+	simd_above(test_bits[SIMD_SCALAR], test_bytes, threshold, TEST_COUNT);
+	for(i = 0; i < ((TEST_COUNT + 63) / 64) * 64; i++)
+	{
+		ASSERT(((test_bits[SIMD_SCALAR][i >> 6] >> (i & 63)) & 1) == (i < TEST_COUNT && test_bytes[i] > threshold));
+	}
+	simd_above_each(test_bits_each[SIMD_SCALAR], test_bytes, test_thresholds, TEST_COUNT);
+	for(i = 0; i < ((TEST_COUNT + 63) / 64) * 64; i++)
+	{
+		ASSERT(((test_bits_each[SIMD_SCALAR][i >> 6] >> (i & 63)) & 1) == (i < TEST_COUNT && test_bytes[i] > test_thresholds[i]));
+	}
+
+	simd_start();
+
+	return(assert_errors);
+}
+
+#endif
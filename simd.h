@@ -0,0 +1,80 @@
+/*
+ * BSD 3-Clause License
+
+ * Copyright (c) 2025, Omniscio
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+/*
+ * simd holds the vectorised inner loops of the channelisers and decoder
+ *
+ * Each kernel has a portable scalar version and SSE2/AVX2 versions that
+ * give bit-for-bit the same results.  The best variant the CPU supports
+ * is chosen at runtime by simd_start().
+ */
+
+#if !defined(SIMD)
+#define SIMD
+
+#include <stddef.h>
+
+typedef enum
+{
+	SIMD_SCALAR=0,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_COUNT
+} simd_t;
+
+// alignment of simd_calloc, a cache line
+#define SIMD_ALIGN	64
+
+// bit i%64 of bits[i/64] is set if input[i] > threshold, the bits past count
+// in the last word are clear
+void simd_above(unsigned long long *bits, const unsigned char *input, unsigned char threshold, int count);
+// the same, against a threshold for each input
+void simd_above_each(unsigned long long *bits, const unsigned char *input, const unsigned char *thresholds, int count);
+
+// radix-2 butterflies over interleaved complex ints, t = hi[k] * twiddles[k]
+// rounded off by bits, then hi[k] = lo[k] - t and lo[k] += t, wrapping at 32
+// bits; the products take 64
+void simd_butterflies(int *lo, int *hi, const int *twiddles, int bits, int count);
+
+simd_t simd(void);
+void *simd_calloc(size_t count, size_t size);
+int simd_set(simd_t variant);
+simd_t simd_start(void);
+int simd_supported(simd_t variant);
+
+// output[i] = sum over taps of filter[tap * stride + i] * inputs[tap][i]
+void simd_fir(int *output, const signed short *filter, int stride, const signed short *const *inputs, int taps, int count);
+
+// state[k] = (state[k] + x) * twiddles[k] for interleaved complex floats
+void simd_sliding(float *state, const float *twiddles, float real, float imag, int bins);
+
+#endif
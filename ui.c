@@ -30,6 +30,8 @@
  * 
  */
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <unistd.h>
 
 #include <SDL2/SDL.h>
@@ -39,6 +41,9 @@
 #include "complex.h"
 #include "config.h"
 //#include "fft.h"
+#include "pool.h"
+#include "resample.h"
+#include "ring.h"
 #include "waterfall.h"
 
 #define ARRAY_SIZE(x)		(sizeof(x)/sizeof(*x))
@@ -47,13 +52,23 @@
 #define UI_SAMPLE_SECONDS	3
 #define UI_SAMPLE_POW2		7
 #define UI_SAMPLE_RATE		(UI_SOUND_RATE >> UI_SAMPLE_POW2)
-#define UI_SAMPLES			(UI_SAMPLE_RATE * UI_SAMPLE_SECONDS)
 
 #define UI_REFRESH_MSEC		50
+// channels are decoded for this long a redraw by default, the rest wait for the next
+#define UI_SYNC_MSEC		(UI_REFRESH_MSEC / 2)
 
 #define UI_SUBCHANNEL_START	6
 #define UI_SUBCHANNELS		56
 
+// skimmer mode takes 16 bit audio or I/Q at skimmer_rate, with channels no wider than this
+#define UI_SKIMMER_CHANNEL_HZ	50
+#define UI_SKIMMER_BUFFER	4096
+
+// captured samples wait this long in the ring for the DSP thread, by default
+#define UI_BUFFER_MSEC		500
+#define UI_DSP_BLOCK		8192
+#define UI_DSP_IDLE_USEC	2000
+
 #define UI_FONT_PATH		"/usr/share/fonts/truetype"
 #define UI_FONT				"freefont/FreeSansBold.ttf"
 #define UI_FONT_HEIGHT		20
@@ -68,7 +83,7 @@
 #define UI_BORDER_BOTTOM	(UI_FONT_HEIGHT)
 
 #define UI_WINDOW_HEIGHT(rows) (UI_BORDER_TOP + UI_TILE_HEIGHT * (rows) + UI_BORDER_BOTTOM)
-#define UI_WINDOW_WIDTH		(UI_BORDER_LEFT + UI_TILE_WIDTH * UI_SAMPLES + UI_BORDER_RIGHT)
+#define UI_WINDOW_WIDTH(samples) (UI_BORDER_LEFT + UI_TILE_WIDTH * (samples) + UI_BORDER_RIGHT)
 
 // #define UI_TEXT_HEIGHT		(UI_ROW_HEIGHT * 24)
 // #define UI_TEXT_WIDTH		(UI_ROW_HEIGHT * 24)
@@ -103,22 +118,39 @@ static struct ui_struct
 	SDL_Texture **ui_glyph_cache_text;
 	SDL_Texture **ui_glyph_cache_decode;
 	SDL_TimerID refresh_timer;
-	int refresh_ms;
+	int refresh_ms, sync_ms;
 	TTF_Font *font;
 	waterfall_t waterfall;
+	waterfall_format_t format;
+	pool_t pool;
+// the audio callback fills the ring and the DSP thread empties it into the
+// waterfall, which the redraw reads without locking through views
+	ring_t ring;
+	pthread_t dsp;
+	atomic_int dsp_stop;
+// the energy version last drawn, and whether the window needs drawing anyway
+	unsigned int drawn;
+	int dirty;
 	int waterfall_rows;
 	int cursor;
+// set up by ui_sound_begin, channel_offset + row is the channel on that row
+	int skimmer, sound_rate, sample_pow2, samples;
+	int first_channel, last_channel, channel_offset;
 	SDL_Window *window;
-	int sound_ptr;
+	resample_t resample;
 	signed short sound[UI_SOUND_RATE * UI_SAMPLE_SECONDS];
 //	complex8_t sound[UI_SOUND_RATE * UI_SAMPLE_SECONDS];
 	struct ui_row_data_struct *row_data;
 } *ui_data = 0;
 
 
+static void *ui_dsp(void *blob);
+static int ui_dsp_begin(struct ui_struct *ui_data);
+static void ui_dsp_end(struct ui_struct *ui_data);
 static SDL_Texture **ui_glyph_cache(TTF_Font *font, SDL_Renderer *renderer, unsigned int ink);
 static void ui_print(SDL_Texture **glyph_cache, SDL_Rect *cursor, char c);
 static void ui_print_textbox(SDL_Texture **glyph_cache, SDL_Rect box, SDL_Color paper, const char *string);
+static void ui_scroll(struct ui_struct *ui_data, int rows);
 static int ui_sound_begin(const char *in_device, const char *out_device);
 static void ui_sound_callback(void *blob, Uint8 *stream, int len);
 static void ui_sound_end(void);
@@ -132,6 +164,54 @@ static void ui_waterfall_redraw_row_text(struct ui_struct *ui_data, int row, int
 static void ui_waterfall_redraw_text(struct ui_struct *ui_data, int subchannel);
 int ui(const char *config_path, const char *config_file);
 
+static void *ui_dsp(void *blob)
+{
+	struct ui_struct *ui_data = (struct ui_struct *) blob;
+	waterfall_input_t input[UI_DSP_BLOCK];
+	int count, values = ui_data->format == WATERFALL_FORMAT_COMPLEX ? 2 : 1;
+
+
+// writes are whole sample frames, so reads of a multiple of values are too
+	while(!atomic_load(&ui_data->dsp_stop))
+	{
+		count = ring_read(ui_data->ring, input, ARRAY_SIZE(input) - ARRAY_SIZE(input) % values);
+
+		if(count)
+		{
+			waterfall_update(ui_data->waterfall, input, count / values);
+		}
+		else
+		{
+			usleep(UI_DSP_IDLE_USEC);
+		}
+	}
+
+	return(0);
+}
+
+static int ui_dsp_begin(struct ui_struct *ui_data)
+{
+	atomic_init(&ui_data->dsp_stop, 0);
+
+	if(pthread_create(&ui_data->dsp, 0, ui_dsp, ui_data))
+	{
+		return(-1);
+	}
+
+	return(0);
+}
+
+static void ui_dsp_end(struct ui_struct *ui_data)
+{
+	atomic_store(&ui_data->dsp_stop, 1);
+	pthread_join(ui_data->dsp, 0);
+
+	if(ring_overruns(ui_data->ring))
+	{
+		fprintf(stderr, "Audio overran the DSP %lu times, %lu samples dropped\n", ring_overruns(ui_data->ring), ring_dropped(ui_data->ring));
+	}
+}
+
 static SDL_Texture **ui_glyph_cache(TTF_Font *font, SDL_Renderer *renderer, unsigned int ink)
 {
 	SDL_Texture **ret = 0;
@@ -220,10 +300,28 @@ static void ui_print_textbox(SDL_Texture **glyph_cache, SDL_Rect box, SDL_Color
 	}
 }
 
+// move the rows over the channels, within the waterfall
+static void ui_scroll(struct ui_struct *ui_data, int rows)
+{
+	ui_data->channel_offset += rows;
+
+	if(ui_data->channel_offset > ui_data->last_channel - ui_data->waterfall_rows)
+	{
+		ui_data->channel_offset = ui_data->last_channel - ui_data->waterfall_rows;
+	}
+	if(ui_data->channel_offset < ui_data->first_channel - 1)
+	{
+		ui_data->channel_offset = ui_data->first_channel - 1;
+	}
+
+	ui_data->cursor = 0;
+	ui_waterfall_clear(ui_data);
+}
+
 static int ui_sound_begin(const char *in_device, const char *out_device)
 {
 	int sound_input_count, sound_output_count;
-	int i;
+	int i, rows = UI_SUBCHANNELS, depth;
 
 
 	sound_output_count = SDL_GetNumAudioDevices(0);
@@ -256,19 +354,32 @@ static int ui_sound_begin(const char *in_device, const char *out_device)
 			return(0);
 		}
 
-		ui_data->audioSpec.freq = 8000;
-		ui_data->audioSpec.format = AUDIO_S8;
-		ui_data->audioSpec.channels = 1;
+		if(config_get(CONFIG_SKIMMER_RATE))
+		{
+// the waterfall takes the samples as they come, so SDL converts to exactly this
+			ui_data->skimmer = 1;
+			ui_data->audioSpec.freq = atoi(config_get(CONFIG_SKIMMER_RATE));
+			ui_data->audioSpec.format = AUDIO_S16SYS;
+			ui_data->audioSpec.channels = (config_get(CONFIG_SKIMMER_IQ) && atoi(config_get(CONFIG_SKIMMER_IQ))) ? 2 : 1;
+			ui_data->audioSpec.samples = UI_SKIMMER_BUFFER;
+			ui_data->audioSpec.size = 0;
+		}
+		else
+		{
+			ui_data->audioSpec.freq = 8000;
+			ui_data->audioSpec.format = AUDIO_S16SYS;
+			ui_data->audioSpec.channels = 1;
+			ui_data->audioSpec.samples = 800;
+			ui_data->audioSpec.size = 0;
+		}
 		ui_data->audioSpec.silence = 0;
-		ui_data->audioSpec.samples = 800;
 		ui_data->audioSpec.padding = 0;
-		ui_data->audioSpec.size = 800;
 		ui_data->audioSpec.callback = ui_sound_callback;
 		ui_data->audioSpec.userdata = (void *) ui_data;
 
 		SDL_ClearError();
 
-		ui_data->audioDevice = SDL_OpenAudioDevice(config_get(CONFIG_AUDIO_INPUT), 1, &(ui_data->audioSpec), &(ui_data->audioSpec), SDL_AUDIO_ALLOW_ANY_CHANGE);
+		ui_data->audioDevice = SDL_OpenAudioDevice(config_get(CONFIG_AUDIO_INPUT), 1, &(ui_data->audioSpec), &(ui_data->audioSpec), ui_data->skimmer ? 0 : SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 		
 		if(*SDL_GetError())
 		{
@@ -278,25 +389,84 @@ static int ui_sound_begin(const char *in_device, const char *out_device)
 	}
 
 
-	switch(ui_data->audioSpec.freq)
+	if(config_get(CONFIG_ROWS) && atoi(config_get(CONFIG_ROWS)) > 0)
+	{
+		rows = atoi(config_get(CONFIG_ROWS));
+	}
+
+	if(ui_data->skimmer)
 	{
-	case 8000:
-	case 16000:
-	case 32000:
-	case 44100:
-		return(UI_SUBCHANNELS);
+		if(ui_data->audioSpec.freq < 2 * UI_SKIMMER_CHANNEL_HZ) return(0);
 
-	default:
-		break;
+		ui_data->sound_rate = ui_data->audioSpec.freq;
+		ui_data->format = ui_data->audioSpec.channels == 2 ? WATERFALL_FORMAT_COMPLEX : WATERFALL_FORMAT_REAL;
+
+		if(config_get(CONFIG_SKIMMER_POW2))
+		{
+			ui_data->sample_pow2 = atoi(config_get(CONFIG_SKIMMER_POW2));
+		}
+		else
+		{
+			for(ui_data->sample_pow2 = 3; (ui_data->sound_rate >> ui_data->sample_pow2) > UI_SKIMMER_CHANNEL_HZ; ui_data->sample_pow2++)
+				;
+		}
+
+// every channel of the block, either side of zero for I/Q
+		ui_data->first_channel = ui_data->format == WATERFALL_FORMAT_COMPLEX ? -(1 << (ui_data->sample_pow2 - 1)) : 0;
+		ui_data->last_channel = (1 << (ui_data->sample_pow2 - 1)) - 1;
+	}
+	else
+	{
+// whatever rate the device gives is resampled to UI_SOUND_RATE
+		ui_data->resample = resample(ui_data->audioSpec.freq, UI_SOUND_RATE);
+		if(!ui_data->resample)
+		{
+			fprintf(stderr, "Cannot resample from %dHz\n", ui_data->audioSpec.freq);
+			return(0);
+		}
+
+		ui_data->sound_rate = UI_SOUND_RATE;
+		ui_data->format = WATERFALL_FORMAT_REAL;
+		ui_data->sample_pow2 = UI_SAMPLE_POW2;
+		ui_data->first_channel = UI_SUBCHANNEL_START + 1;
+		ui_data->last_channel = UI_SUBCHANNEL_START + rows;
+		if(ui_data->last_channel >= 1 << (UI_SAMPLE_POW2 - 1)) ui_data->last_channel = (1 << (UI_SAMPLE_POW2 - 1)) - 1;
 	}
 
-	return(0);
+	ui_data->samples = (ui_data->sound_rate >> ui_data->sample_pow2) * UI_SAMPLE_SECONDS;
+	ui_data->channel_offset = ui_data->first_channel - 1;
+
+	if(rows > 1 + ui_data->last_channel - ui_data->first_channel)
+	{
+		rows = 1 + ui_data->last_channel - ui_data->first_channel;
+	}
+
+// at least two callbacks' worth, so one can be written while the other is read
+	depth = UI_BUFFER_MSEC;
+	if(config_get(CONFIG_BUFFER_MS) && atoi(config_get(CONFIG_BUFFER_MS)) > 0)
+	{
+		depth = atoi(config_get(CONFIG_BUFFER_MS));
+	}
+	depth = (int) (((long long) depth * ui_data->sound_rate * (ui_data->format == WATERFALL_FORMAT_COMPLEX ? 2 : 1)) / 1000);
+	if(depth < 2 * ui_data->audioSpec.samples * ui_data->audioSpec.channels)
+	{
+		depth = 2 * ui_data->audioSpec.samples * ui_data->audioSpec.channels;
+	}
+
+	ui_data->ring = ring(depth);
+	if(!ui_data->ring)
+	{
+		fprintf(stderr, "ring(depth=%d) failed\n", depth);
+		return(0);
+	}
+
+	return(rows);
 }
 
 static void ui_sound_callback(void *blob, Uint8 *stream, int len)
 {
 	struct ui_struct *ui_data = (struct ui_struct *) blob;
-	int i, sound_bytes, sound_count; //, j;
+	int sound_bytes, sound_count;
 
 
 //fprintf(stderr, "ui_sound_callback(blob,stream,len=%d)\n", len);
@@ -306,84 +476,33 @@ static void ui_sound_callback(void *blob, Uint8 *stream, int len)
 
 //fprintf(stderr, "sound_bytes=%d,sound_count=%d\n", sound_bytes, sound_count);
 
-// TODO: check for overflows
-
-	i = 0;	// TODO: this should age to the actual channel byte(s)
-	while(i < sound_count)
+// never waits on the DSP, if the ring is full the samples are dropped and counted
+	if(ui_data->skimmer)
 	{
-		if(ui_data->sound_ptr + 16 > (int) ARRAY_SIZE(ui_data->sound))
-		{
-			waterfall_update(ui_data->waterfall, ui_data->sound, ui_data->sound_ptr);
-			ui_data->sound_ptr = 0;
-		}
-
-// decimation to get to 6400 samples/second
-		switch(ui_data->audioSpec.freq)
-		{
-		case 8000:
-			ui_data->sound[ui_data->sound_ptr] = stream[i * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +1] = stream[(i + 1) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +2] = stream[(i + 2) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +3] = stream[(i + 3) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound_ptr += 4;
-			i += 5;
-			break;
-
-		case 16000:
-			ui_data->sound[ui_data->sound_ptr] = stream[i * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +1] = stream[(i + 2) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound_ptr += 2;
-			i += 5;
-			break;
-
-		case 32000:
-			ui_data->sound[ui_data->sound_ptr] = stream[i * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound_ptr += 1;
-			i += 5;
-			break;
-
-		case 41200:
-			ui_data->sound[ui_data->sound_ptr] = stream[i * sound_bytes * ui_data->audioSpec.channels] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +1] = stream[(i + 6) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +2] = stream[(i + 13) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +3] = stream[(i + 19) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +4] = stream[(i + 26) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +5] = stream[(i + 32) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +6] = stream[(i + 39) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +7] = stream[(i + 45) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +8] = stream[(i + 52) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +9] = stream[(i + 58) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +10] = stream[(i + 64) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +11] = stream[(i + 71) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +12] = stream[(i + 77) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +13] = stream[(i + 84) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +14] = stream[(i + 90) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound[ui_data->sound_ptr +15] = stream[(i + 97) * sound_bytes] - ui_data->audioSpec.silence;
-			ui_data->sound_ptr += 16;
-			i += 103;
-			break;
-
-		default:
-			// TODO: something intelligent, not just bail
-			return;
-		}
+		ring_write(ui_data->ring, (const signed short *) stream, sound_count * ui_data->audioSpec.channels);
+		return;
 	}
 
-	waterfall_update(ui_data->waterfall, ui_data->sound, ui_data->sound_ptr);
-	ui_data->sound_ptr = 0;
+// filtered down to UI_SOUND_RATE, so nothing above its Nyquist aliases into the channels
+	sound_count = resample_run(ui_data->resample, ui_data->sound, ARRAY_SIZE(ui_data->sound), (const signed short *) stream, sound_count);
+	ring_write(ui_data->ring, ui_data->sound, sound_count);
 }
 
 static void ui_sound_end(void)
 {
 	SDL_PauseAudioDevice(ui_data->audioDevice, 1);
 	SDL_CloseAudioDevice(ui_data->audioDevice);
+	ring_dlete(ui_data->ring);
+	ui_data->ring = 0;
+	resample_dlete(ui_data->resample);
+	ui_data->resample = 0;
 }
 
 
 static int ui_waterfall_begin(int rows)
 {
 	ui_data->waterfall_rows  = rows;
-	ui_data->waterfall = waterfall(UI_SAMPLE_POW2, UI_SAMPLES, UI_SUBCHANNEL_START, UI_SUBCHANNEL_START + rows, (UI_WINDOW_HEIGHT(ui_data->waterfall_rows)) / UI_FONT_HEIGHT - 4, UI_WINDOW_WIDTH / UI_FONT_WIDTH - 2);
+	ui_data->waterfall = waterfall(ui_data->format, ui_data->sample_pow2, ui_data->samples, ui_data->first_channel, ui_data->last_channel, (UI_WINDOW_HEIGHT(ui_data->waterfall_rows)) / UI_FONT_HEIGHT - 4, UI_WINDOW_WIDTH(ui_data->samples) / UI_FONT_WIDTH - 2);
 
 	ui_data->font = TTF_OpenFont(UI_FONT_PATH "/" UI_FONT, UI_FONT_HEIGHT);
 	
@@ -395,13 +514,13 @@ static int ui_waterfall_begin(int rows)
 	
 	if(!ui_data->waterfall)
 	{
-		fprintf(stderr, "waterfall(input_sampling_power_of_two=%d,samples=%d,first_channel=%d,last_channel=%d,rows=%d,cols=%d) failed\n", UI_SAMPLE_POW2, UI_SAMPLES, UI_SUBCHANNEL_START, UI_SUBCHANNEL_START + rows, rows - 2, UI_WINDOW_WIDTH / UI_FONT_WIDTH - 2);
+		fprintf(stderr, "waterfall(format=%d,input_sampling_power_of_two=%d,samples=%d,first_channel=%d,last_channel=%d,rows=%d,cols=%d) failed\n", ui_data->format, ui_data->sample_pow2, ui_data->samples, ui_data->first_channel, ui_data->last_channel, rows - 2, UI_WINDOW_WIDTH(ui_data->samples) / UI_FONT_WIDTH - 2);
 		return(-3);
 	}
 	
 
 	ui_data->window = SDL_CreateWindow("Morserator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
-				UI_WINDOW_WIDTH, UI_WINDOW_HEIGHT(rows), 0);
+				UI_WINDOW_WIDTH(ui_data->samples), UI_WINDOW_HEIGHT(rows), 0);
 
 	if(ui_data->window)
 	{
@@ -441,33 +560,54 @@ static void ui_waterfall_clear(struct ui_struct *ui_data)
 	SDL_Rect r;
 
 	
-	r.w = UI_WINDOW_WIDTH;
+	r.w = UI_WINDOW_WIDTH(ui_data->samples);
 	r.h = UI_WINDOW_HEIGHT(ui_data->waterfall_rows);
 	r.x = 0;
 	r.y = 0;
 
 	SDL_SetRenderDrawColor(ui_data->renderer, UI_COLOUR_R(UI_BORDER_COLOUR), UI_COLOUR_G(UI_BORDER_COLOUR), UI_COLOUR_B(UI_BORDER_COLOUR), 0xFF);
 	SDL_RenderFillRect(ui_data->renderer, &r);
+
+	ui_data->dirty = 1;
 }
 
 static void ui_waterfall_end(void)
 {
-	int refresh_ms = ui_data->refresh_ms;
+	waterfall_schedule_t schedule;
+	unsigned long deferrals = 0;
+	int refresh_ms = ui_data->refresh_ms, i, deferred = 0;
 
 	ui_data->refresh_ms = 0;
 	usleep(refresh_ms * 10);
+
+	for(i = ui_data->first_channel; !waterfall_schedule(ui_data->waterfall, i, &schedule); i++)
+	{
+		deferrals += schedule.deferrals;
+		if(schedule.deferrals) deferred++;
+	}
+	if(deferrals)
+	{
+		fprintf(stderr, "Decoding overran its %dms budget, %d channels were put off %lu times\n", ui_data->sync_ms, deferred, deferrals);
+	}
+
 	waterfall_dlete(ui_data->waterfall);
 }
 
 static void ui_waterfall_redraw(struct ui_struct *ui_data)
 {
+	waterfall_view_t view;
 	int i;
 
 
-	for(i = 1; i <= ui_data->waterfall_rows; i++)
-	{
-		waterfall_sync(ui_data->waterfall, i + UI_SUBCHANNEL_START);
-	}
+// decode every channel, not just the ones on show, spread over the pool,
+// the one under the cursor first and as many of the rest as there's time for
+	waterfall_sync_budget(ui_data->waterfall, ui_data->pool, ui_data->cursor > 0 ? ui_data->cursor + ui_data->channel_offset : ui_data->first_channel - 1, ui_data->sync_ms * 1000L);
+
+// nothing to draw until the DSP has moved on
+	waterfall_view(ui_data->waterfall, ui_data->first_channel, &view);
+	if(!ui_data->dirty && view.head == ui_data->drawn) return;
+	ui_data->drawn = view.head;
+	ui_data->dirty = 0;
 
 	if(ui_data->cursor > 0)
 	{
@@ -499,43 +639,50 @@ static void ui_waterfall_redraw(struct ui_struct *ui_data)
 static void ui_waterfall_redraw_row_power(struct ui_struct *ui_data, int row, int subchannel, int single)
 {
 	const morse_decode_t *symbols = 0;
-	const db_t *colours = 0;
+	waterfall_view_t view;
+	db_t colour;
 	SDL_Rect r;
 #if defined(UI_MARK_COLOUR)
 	int x1, x2, y;
 #endif
 	unsigned int i;
 
-	colours = waterfall_colours(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
-
 	r.w = UI_TILE_WIDTH;
 	r.h = UI_TILE_HEIGHT;
 	
 	r.y = UI_BORDER_TOP + UI_TILE_HEIGHT * (row - 0);
 	y = r.y + UI_TILE_HEIGHT / 2;
 	
-	for(i = 0; i < UI_SAMPLES; i++)
+// read in place, and drawn again in the rare case the DSP overwrote it meanwhile
+	do
 	{
-		r.x = UI_BORDER_LEFT + i * UI_TILE_WIDTH;
+		waterfall_view(ui_data->waterfall, subchannel + ui_data->channel_offset, &view);
 
-		if(colours[i] < 16)
+		for(i = 0; i < (unsigned int) ui_data->samples; i++)
 		{
-			SDL_SetRenderDrawColor(ui_data->renderer, 0, 0, colours[i] << 4, 0xFF);
-		}
-		else if(colours[i] < 32)
-		{
-			SDL_SetRenderDrawColor(ui_data->renderer, 0, (colours[i] - 16) << 4, 0xFF, 0xFF);
-		}
-		else
-		{
-			SDL_SetRenderDrawColor(ui_data->renderer, (colours[i] - 32) << 4, 0xFF, 0xFF, 0xFF);
-		}
+			r.x = UI_BORDER_LEFT + i * UI_TILE_WIDTH;
+			colour = WATERFALL_VIEW(&view, i);
 
-		SDL_RenderFillRect(ui_data->renderer, &r);
+			if(colour < 16)
+			{
+				SDL_SetRenderDrawColor(ui_data->renderer, 0, 0, colour << 4, 0xFF);
+			}
+			else if(colour < 32)
+			{
+				SDL_SetRenderDrawColor(ui_data->renderer, 0, (colour - 16) << 4, 0xFF, 0xFF);
+			}
+			else
+			{
+				SDL_SetRenderDrawColor(ui_data->renderer, (colour - 32) << 4, 0xFF, 0xFF, 0xFF);
+			}
+
+			SDL_RenderFillRect(ui_data->renderer, &r);
+		}
 	}
+	while(!waterfall_view_valid(ui_data->waterfall, &view));
 
-	symbols = waterfall_symbols(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
-	waterfall_start(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
+	symbols = waterfall_symbols(ui_data->waterfall, subchannel + ui_data->channel_offset);
+	waterfall_start(ui_data->waterfall, subchannel + ui_data->channel_offset);
 
 	r.w = UI_FONT_WIDTH;
 	
@@ -544,12 +691,12 @@ static void ui_waterfall_redraw_row_power(struct ui_struct *ui_data, int row, in
 	{
 		if(symbols[i].mark && symbols[i].age)
 		{
-			x1 = UI_SAMPLES - symbols[i].age;
-			x2 = UI_SAMPLES - symbols[i].age + symbols[i].mark;
+			x1 = ui_data->samples - symbols[i].age;
+			x2 = ui_data->samples - symbols[i].age + symbols[i].mark;
 			if(x1 < 0) x1 = 0;
 			if(x2 < 0) x2 = 0;
-			if(x1 > UI_SAMPLES) x1 = UI_SAMPLES;
-			if(x2 > UI_SAMPLES) x2 = UI_SAMPLES;
+			if(x1 > ui_data->samples) x1 = ui_data->samples;
+			if(x2 > ui_data->samples) x2 = ui_data->samples;
 			
 			if(x1 != x2)
 			{
@@ -564,6 +711,7 @@ static void ui_waterfall_redraw_row_power(struct ui_struct *ui_data, int row, in
 static void ui_waterfall_redraw_row_text(struct ui_struct *ui_data, int row, int subchannel, int single)
 {
 	const morse_decode_t *symbols = 0;
+	waterfall_schedule_t schedule;
 //	morse_fist_t fist = 0;
 	char left[(UI_BORDER_LEFT/UI_FONT_WIDTH) + 1];
 	char right[(UI_BORDER_RIGHT/UI_FONT_WIDTH) + 1];
@@ -595,7 +743,7 @@ static void ui_waterfall_redraw_row_text(struct ui_struct *ui_data, int row, int
 		r.y = UI_BORDER_TOP + UI_TILE_HEIGHT * (ui_data->waterfall_rows - 2) - UI_FONT_HEIGHT/2;
 	}
 
-	symbols = waterfall_symbols(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
+	symbols = waterfall_symbols(ui_data->waterfall, subchannel + ui_data->channel_offset);
 
 	r.w = UI_FONT_WIDTH;
 
@@ -603,23 +751,29 @@ static void ui_waterfall_redraw_row_text(struct ui_struct *ui_data, int row, int
 	{
 		for(i = 0; symbols && symbols[i].age; i++)
 		{
-			if(symbols[i].text && symbols[i].age > UI_FONT_WIDTH && symbols[i].age < UI_SAMPLES)
+			if(symbols[i].text && symbols[i].age > UI_FONT_WIDTH && symbols[i].age < ui_data->samples)
 			{
-				r.x = UI_BORDER_LEFT + UI_TILE_WIDTH * (UI_SAMPLES - symbols[i].age);
+				r.x = UI_BORDER_LEFT + UI_TILE_WIDTH * (ui_data->samples - symbols[i].age);
 				ui_print(ui_data->ui_glyph_cache_decode, &r, symbols[i].text);
 				active++;
 			}
 		}
 	}
 
-	if(((subchannel - 1 + UI_SUBCHANNEL_START) & 0x03) == 0 || single)
+	if(((subchannel - 1 + ui_data->channel_offset) & 0x03) == 0 || single)
+	{
+		snprintf(right, ARRAY_SIZE(right), "%lld",  ((long long) ui_data->sound_rate * (subchannel - 1 + ui_data->channel_offset)) >> ui_data->sample_pow2);
+	}
+
+// channels put off for want of time show how many redraws they've missed
+	if(!waterfall_schedule(ui_data->waterfall, subchannel + ui_data->channel_offset, &schedule) && schedule.deferred)
 	{
-		snprintf(right, ARRAY_SIZE(right), "%d",  UI_SAMPLE_RATE * (subchannel - 1 + UI_SUBCHANNEL_START));
+		snprintf(left, ARRAY_SIZE(left), "+%u", schedule.deferred);
 	}
 
-//	snprintf(left, ARRAY_SIZE(left), "%d", waterfall_text_lines(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START));
+//	snprintf(left, ARRAY_SIZE(left), "%d", waterfall_text_lines(ui_data->waterfall, subchannel + ui_data->channel_offset));
 
-//	fist = waterfall_fist(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
+//	fist = waterfall_fist(ui_data->waterfall, subchannel + ui_data->channel_offset);
 	
 //	if(fist)
 //	{
@@ -635,7 +789,7 @@ static void ui_waterfall_redraw_row_text(struct ui_struct *ui_data, int row, int
 
 	if(*right)
 	{
-		r.x = UI_WINDOW_WIDTH - UI_BORDER_RIGHT + UI_FONT_WIDTH;
+		r.x = UI_WINDOW_WIDTH(ui_data->samples) - UI_BORDER_RIGHT + UI_FONT_WIDTH;
 		r.w = UI_BORDER_RIGHT - UI_FONT_WIDTH * 2;
 		ui_print_textbox(ui_data->ui_glyph_cache_text, r, paper, right);
 	} 
@@ -648,13 +802,13 @@ static void ui_waterfall_redraw_text(struct ui_struct *ui_data, int subchannel)
 	SDL_Rect r;
 
 
-	string = waterfall_text(ui_data->waterfall, subchannel + UI_SUBCHANNEL_START);
+	string = waterfall_text(ui_data->waterfall, subchannel + ui_data->channel_offset);
 
 //fprintf(stderr, "waterfall_text(ui_data->waterfall,subchannel=%d)=\"%s\"\n", (int) subchannel, string);
 
 	r.y = UI_BORDER_TOP;
 	r.x = UI_FONT_WIDTH;
-	r.w = UI_WINDOW_WIDTH - 2 * UI_FONT_WIDTH;
+	r.w = UI_WINDOW_WIDTH(ui_data->samples) - 2 * UI_FONT_WIDTH;
 	r.h = UI_WINDOW_HEIGHT(ui_data->waterfall_rows) - 4 * UI_FONT_HEIGHT;
 
 	paper.r = UI_COLOUR_R(UI_TEXTBOX_COLOUR);
@@ -688,13 +842,20 @@ int ui(const char *config_path, const char *config_file)
 		return(2);
 	}
 
+	ui_data->pool = pool(config_get(CONFIG_THREADS) ? atoi(config_get(CONFIG_THREADS)) : 0);
+	ui_data->sync_ms = UI_SYNC_MSEC;
+	if(config_get(CONFIG_SYNC_MS) && atoi(config_get(CONFIG_SYNC_MS)) > 0)
+	{
+		ui_data->sync_ms = atoi(config_get(CONFIG_SYNC_MS));
+	}
+
 	if(!SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) && !TTF_Init())
 	{
 		rows = ui_sound_begin(config_get(CONFIG_AUDIO_INPUT), config_get(CONFIG_AUDIO_OUTPUT));
 		
 		if(rows)
 		{
-			if(!ui_waterfall_begin(rows))
+			if(!ui_waterfall_begin(rows) && !ui_dsp_begin(ui_data))
 			{
 				SDL_PauseAudioDevice(ui_data->audioDevice, 0);
 
@@ -721,6 +882,23 @@ int ui(const char *config_path, const char *config_file)
 						}
 						break;
 
+					case SDL_MOUSEWHEEL:
+						ui_scroll(ui_data, e.wheel.y);
+						break;
+
+					case SDL_KEYDOWN:
+						switch(e.key.keysym.sym)
+						{
+						case SDLK_UP: ui_scroll(ui_data, 1); break;
+						case SDLK_DOWN: ui_scroll(ui_data, -1); break;
+						case SDLK_PAGEUP: ui_scroll(ui_data, ui_data->waterfall_rows); break;
+						case SDLK_PAGEDOWN: ui_scroll(ui_data, -ui_data->waterfall_rows); break;
+						case SDLK_HOME: ui_scroll(ui_data, ui_data->last_channel - ui_data->first_channel); break;
+						case SDLK_END: ui_scroll(ui_data, ui_data->first_channel - ui_data->last_channel); break;
+						default: break;
+						}
+						break;
+
 					default:
 						// do nothing
 						break;
@@ -730,6 +908,7 @@ int ui(const char *config_path, const char *config_file)
 
 				SDL_PauseAudioDevice(ui_data->audioDevice, 1);
 
+				ui_dsp_end(ui_data);
 				ui_waterfall_end();
 			}
 			else
@@ -746,6 +925,8 @@ int ui(const char *config_path, const char *config_file)
 	TTF_Quit();
 	SDL_Quit();
 
+	pool_dlete(ui_data->pool);
+
 	sleep(1);
 	ui_data = 0;
 
@@ -30,11 +30,16 @@
  * 
  */
 
+#include <limits.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "fft.h"
+#include "simd.h"
 #include "waterfall.h"
 
 #define ARRAY_SIZE(array)	(sizeof(array)/sizeof(*array))
@@ -42,83 +47,203 @@
 //#define WATERFALL_QUALITY	230
 #define WATERFALL_THRESHOLD_DB			+8
 #define WATERFALL_THRESHOLD_ONOFF		3
-#define WATERFALL_THRESHOLD_COEFFICIENT	9
+// a channel whose on and off levels are this far apart sets its own threshold,
+// the DSP checking each channel's levels every WATERFALL_SLICE_ROWS rows
+#define WATERFALL_THRESHOLD_BIMODAL		(2 * WATERFALL_THRESHOLD_DB)
+#define WATERFALL_SLICE_ROWS			8
+
+// each channel's noise floor is in 1/WATERFALL_FLOOR_ONE dB, and steps this
+// far towards every new value
+#define WATERFALL_FLOOR_ONE				256
+#define WATERFALL_FLOOR_STEP			16
+
+// the rows of each channel's last WATERFALL_TRANSITIONS crossings of its
+// threshold are kept, and it is decoded while WATERFALL_ACTIVITY_WAKE of them
+// are in the last WATERFALL_ACTIVITY_ROWS rows, two marks
+#define WATERFALL_TRANSITIONS			64
+#define WATERFALL_ACTIVITY_WAKE			4
+#define WATERFALL_ACTIVITY_ROWS			32
+
+// a budgeted sync ranks channels by how far apart their on and off levels are
+// now, plus one for every 2^SHIFT rows since they were last synced, so none
+// waits forever
+#define WATERFALL_SCHEDULE_STALE_SHIFT	3
 
 //#define WATERFALL_FILTER_SIZE	4
 #define WATERFALL_FILTER_COEFFICIENT 	20
 
-#define FFT_COS12_TABLE_BITS			12
+// sliding DFT bins either side of a channel needed by the widest window
+#define WATERFALL_SLIDING_SKIRT			2
+// damping of the sliding DFT over one block, to stop rounding errors accumulating
+#define WATERFALL_SLIDING_DAMPING		(1.0 - 1.0 / 256)
 
-#define COS12(x)	cos12[(x) & ((1 << FFT_COS12_TABLE_BITS) - 1)]
-#define SIN12(x)	COS12((x) - (1 << (FFT_COS12_TABLE_BITS - 2)))
+// blocks spanned by the polyphase prototype filter, and its precision
+#define WATERFALL_POLYPHASE_TAPS		8
+#define WATERFALL_POLYPHASE_BITS		14
 
+#define WATERFALL_ARENA_ROUND(size)		(((size) + SIMD_ALIGN - 1) & ~((size_t) SIMD_ALIGN - 1))
+
+// the buffers are slices of the waterfall's arena, synced is the energy row
+// the channel was last decoded up to, crossings how many of its crossings
+// came before it, idle that it wasn't decoded then, and version counts the
+// times its symbols or text were rewritten
 struct waterfall_channel_struct
 {
 	morse_fist_t fist;
-	db_t *colours, *inputs;
+	db_t *colours;
 	morse_decode_t *decodes;
 	char *text;
-	int start, text_end;
+	int start, text_end, idle;
 #if defined(WATERFALL_FILTER_SIZE)
 	db_t filter[WATERFALL_FILTER_SIZE];
 #endif
-	unsigned char updates;
-	db_t threshold;
+	unsigned int synced, crossings, latency, deferred, deferrals, version;
+};
+
+struct waterfall_rank_struct
+{
+	unsigned int priority;
+	int channel;
+};
+
+// one budgeted sync, kept by its caller so no two share it: its keyed
+// channels, best first, ranked of them, next is the first not yet taken by a
+// thread and deadline when the rest are put off, in microseconds
+struct waterfall_round_struct
+{
+	waterfall_t waterfall;
+	struct waterfall_rank_struct *ranks;
+	int ranked;
+	atomic_int next;
+	long long deadline;
+};
+
+struct waterfall_sliding_struct
+{
+	float real;
+	float imag;
+};
+
+// shorts per sample, and the hot loops specialised for the format
+struct waterfall_format_struct
+{
+	int values;
+	void (*update_block)(waterfall_t waterfall, const waterfall_input_t *block);
+	void (*update_sliding)(waterfall_t waterfall, const waterfall_input_t *input, int input_count);
 };
 
 struct waterfall_struct
 {
-	int subchannels, first_subchannel, input_sampling_power_of_two, buffer_count, samples, rows, cols;
+	const struct waterfall_format_struct *format;
+	int subchannels, first_subchannel, input_sampling_power_of_two, buffer_count, samples, history_size, rows, cols;
 	waterfall_input_t *buffer;
-	db_integer_t average;
+	fft_t fft;
+	fft_complex_t *bins;
+// sliding DFT state, buffer holds the last block of input as a delay line
+	waterfall_channeliser_t channeliser;
+	waterfall_window_t window;
+	int hop, hop_count;
+	float damping;
+	struct waterfall_sliding_struct *sliding, *sliding_twiddles;
+// one allocation for everything sized by the channel count; energy is a
+// ring of history_size rows of one value per channel, and head counts the
+// rows written, published only once a row is complete
+	void *arena;
+	db_t *energy;
+	atomic_uint head;
+// a histogram per channel of its last samples rows, MORSE_LEVELS bins each,
+// each channel's noise floor, and how many times it has crossed the threshold
+// above the floor, written only by the DSP
+	atomic_uint *levels, *floors, *transition_counts;
+// each channel's threshold for the row being written, from a floor that
+// already counts it, or the midpoint of its on and off levels in slices if
+// it is keyed, a bit per channel set if it was above it on the last row, the
+// bits for the row being written, and a ring of the rows each channel crossed
+// its threshold on
+	db_t *thresholds, *slices;
+	unsigned long long *above, *crossed;
+	unsigned int *transitions;
+// polyphase state, history holds the last WATERFALL_POLYPHASE_TAPS blocks
+	signed short *polyphase_filter;
+	int polyphase_block, *polyphase_sum;
+	waterfall_input_t *polyphase_history;
+	signed short *polyphase_output;
 	struct waterfall_channel_struct channels[];
 };
 
 
-waterfall_t waterfall(int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols);
+waterfall_t waterfall(waterfall_format_t format, int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols);
+static int waterfall_active(waterfall_t waterfall, int channel);
+int waterfall_channeliser_set(waterfall_t waterfall, waterfall_channeliser_t channeliser, int hop, waterfall_window_t window);
 void waterfall_clear(waterfall_t waterfall, int subchannel);
 const db_t *waterfall_colours(waterfall_t waterfall, int subchannel);
-static void waterfall_cos12_start(void);
 void waterfall_dlete(waterfall_t waterfall);
-static db_t waterfall_fft_row(const waterfall_input_t *in, int logcount, int row);
 const morse_fist_t waterfall_fist(waterfall_t waterfall, int subchannel);
 db_t waterfall_get(db_t *colours, int colours_size, waterfall_t waterfall, int subchannel);
+static int waterfall_history(waterfall_t waterfall, int channel, unsigned int head, int count, db_t *output);
+static db_t waterfall_levels(waterfall_t waterfall, int channel, int *bimodality);
+static int waterfall_rank(waterfall_t waterfall, int focus, struct waterfall_rank_struct *ranks);
+static int waterfall_rank_compare(const void *a, const void *b);
+static inline db_t *waterfall_row(waterfall_t waterfall, unsigned int row);
+int waterfall_schedule(waterfall_t waterfall, int subchannel, waterfall_schedule_t *schedule);
 int waterfall_start(waterfall_t waterfall, int subchannel);
 const morse_decode_t *waterfall_symbols(waterfall_t waterfall, int subchannel);
 int waterfall_sync(waterfall_t waterfall, int subchannel);
+void waterfall_sync_all(waterfall_t waterfall, pool_t pool);
+void waterfall_sync_budget(waterfall_t waterfall, pool_t pool, int focus, long budget_usec);
+static void waterfall_sync_range(void *blob, int first, int last);
+static void waterfall_sync_ranked(void *blob, int first, int last);
 const char *waterfall_text(waterfall_t waterfall, int subchannel);
 int waterfall_text_lines(waterfall_t waterfall, int subchannel);
+int waterfall_transitions(waterfall_t waterfall, int subchannel, unsigned int since, waterfall_transition_t *transitions, int size);
+static int waterfall_crossings(waterfall_t waterfall, int channel, unsigned int *first, unsigned int *rows, int size);
+static int waterfall_unwritten(waterfall_t waterfall, unsigned int head, int count);
+static long long waterfall_usec(void);
 void waterfall_update(waterfall_t waterfall, const waterfall_input_t *input, int input_count);
-static db_integer_t waterfall_update_block(waterfall_t waterfall, const waterfall_input_t *block);
-
-static const int *cos12;
+static void waterfall_update_block_complex(waterfall_t waterfall, const waterfall_input_t *block);
+static inline void waterfall_update_block_format(waterfall_t waterfall, const waterfall_input_t *block, const waterfall_format_t format);
+static void waterfall_update_block_real(waterfall_t waterfall, const waterfall_input_t *block);
+static inline void waterfall_update_channel(waterfall_t waterfall, db_t *row, const db_t *expired, int channel, db_t power);
+static inline int waterfall_update_polyphase_format(waterfall_t waterfall, const waterfall_input_t *block, const waterfall_format_t format);
+static void waterfall_update_row(waterfall_t waterfall, const db_t *row, unsigned int head);
+static void waterfall_update_sliding_complex(waterfall_t waterfall, const waterfall_input_t *input, int input_count);
+static inline void waterfall_update_sliding_format(waterfall_t waterfall, const waterfall_input_t *input, int input_count, const waterfall_format_t format);
+static void waterfall_update_sliding_hop(waterfall_t waterfall);
+static void waterfall_update_sliding_real(waterfall_t waterfall, const waterfall_input_t *input, int input_count);
+unsigned int waterfall_version(waterfall_t waterfall, int subchannel);
+int waterfall_view(waterfall_t waterfall, int subchannel, waterfall_view_t *view);
+int waterfall_view_valid(waterfall_t waterfall, const waterfall_view_t *view);
+
+static const struct waterfall_format_struct waterfall_formats[WATERFALL_FORMAT_COUNT] =
+{
+	{ 1, waterfall_update_block_real, waterfall_update_sliding_real },
+	{ 2, waterfall_update_block_complex, waterfall_update_sliding_complex },
+};
 
 
 
-waterfall_t waterfall(int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols)
+waterfall_t waterfall(waterfall_format_t format, int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols)
 {
 	struct waterfall_channel_struct *c = 0;
 	waterfall_t waterfall = 0;
-	int first_subchannel, subchannels;
+	morse_fist_t fist = 0;
+	struct morse_fist_struct *fists = 0;
+	morse_decode_t *decodes = 0;
+	db_t *colours = 0;
+	char *text = 0, *arena = 0;
+	size_t energy_size, colours_size, decodes_size, text_size, fists_size, levels_size, floors_size, transition_counts_size, thresholds_size, slices_size, above_size, transitions_size;
+	int first_subchannel, subchannels, lowest_channel;
 	int i;
 
-	if(input_sampling_power_of_two <= 2 || samples <= 0) return(0);
+	if(format < 0 || format >= WATERFALL_FORMAT_COUNT || input_sampling_power_of_two <= 2 || input_sampling_power_of_two > FFT_LOG_SIZE_MAX || samples <= 0) return(0);
 
-#if defined(WATERFALL_COMPLEX_INPUT)
-	if(first_channel <= -(1 << (input_sampling_power_of_two - 1)) || first_channel >= (1 << (input_sampling_power_of_two - 1))
-	|| last_channel <= -(1 << (input_sampling_power_of_two - 1)) || last_channel >= (1 << (input_sampling_power_of_two - 1)))
-	{
-		return(0);
-	}
-#else
-	if(first_channel < 0 || first_channel >= (1 << (input_sampling_power_of_two - 1))
-	|| last_channel < 0 || last_channel >= (1 << (input_sampling_power_of_two - 1)))
+	lowest_channel = format == WATERFALL_FORMAT_COMPLEX ? -(1 << (input_sampling_power_of_two - 1)) : 0;
+
+	if(first_channel < lowest_channel || first_channel >= (1 << (input_sampling_power_of_two - 1))
+	|| last_channel < lowest_channel || last_channel >= (1 << (input_sampling_power_of_two - 1)))
 	{
 		return(0);
 	}
-#endif
-
-	if(!cos12) waterfall_cos12_start();
 
 	if(first_channel > last_channel)
 	{
@@ -132,34 +257,218 @@ waterfall_t waterfall(int input_sampling_power_of_two, int samples, int first_ch
 	}
 
 
+	simd_start();
+
 	waterfall = (waterfall_t) calloc(1, sizeof(struct waterfall_struct) + subchannels * sizeof(struct waterfall_channel_struct));
 
-	waterfall->buffer = (waterfall_input_t *) calloc(1 << input_sampling_power_of_two, sizeof(waterfall_input_t));
+	waterfall->format = waterfall_formats + format;
+	waterfall->buffer = (waterfall_input_t *) simd_calloc(waterfall->format->values << input_sampling_power_of_two, sizeof(waterfall_input_t));
+
+	waterfall->fft = fft(input_sampling_power_of_two);
+	if(format == WATERFALL_FORMAT_COMPLEX)
+	{
+		waterfall->bins = (fft_complex_t *) simd_calloc(1 << input_sampling_power_of_two, sizeof(fft_complex_t));
+	}
+	else
+	{
+		waterfall->bins = (fft_complex_t *) simd_calloc((1 << (input_sampling_power_of_two - 1)) + 1, sizeof(fft_complex_t));
+	}
 
 	waterfall->first_subchannel = first_subchannel;
 	waterfall->subchannels = subchannels;
 	waterfall->input_sampling_power_of_two = input_sampling_power_of_two;
 	waterfall->samples = samples;
+// twice the window at least, so a reader has the slack to finish before the DSP laps it
+	for(waterfall->history_size = 1; waterfall->history_size < 2 * samples; waterfall->history_size <<= 1)
+		;
 	waterfall->rows = rows;
 	waterfall->cols = cols;
+	waterfall->channeliser = WATERFALL_CHANNELISER_BLOCK;
+	waterfall->hop = 1 << input_sampling_power_of_two;
 	
+// each array starts on its own cache line
+	energy_size = WATERFALL_ARENA_ROUND((size_t) waterfall->history_size * subchannels * sizeof(db_t));
+	colours_size = WATERFALL_ARENA_ROUND((size_t) subchannels * samples * sizeof(db_t));
+	decodes_size = WATERFALL_ARENA_ROUND((size_t) subchannels * samples * sizeof(morse_decode_t));
+	text_size = WATERFALL_ARENA_ROUND((size_t) subchannels * rows * cols * sizeof(char));
+	fists_size = WATERFALL_ARENA_ROUND((size_t) subchannels * sizeof(struct morse_fist_struct));
+	levels_size = WATERFALL_ARENA_ROUND((size_t) subchannels * MORSE_LEVELS * sizeof(atomic_uint));
+	floors_size = WATERFALL_ARENA_ROUND((size_t) subchannels * sizeof(atomic_uint));
+	transition_counts_size = WATERFALL_ARENA_ROUND((size_t) subchannels * sizeof(atomic_uint));
+	thresholds_size = WATERFALL_ARENA_ROUND((size_t) subchannels * sizeof(db_t));
+	slices_size = WATERFALL_ARENA_ROUND((size_t) subchannels * sizeof(db_t));
+	above_size = WATERFALL_ARENA_ROUND((size_t) ((subchannels + 63) >> 6) * sizeof(unsigned long long));
+	transitions_size = WATERFALL_ARENA_ROUND((size_t) subchannels * WATERFALL_TRANSITIONS * sizeof(unsigned int));
+
+	arena = (char *) simd_calloc(energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size + thresholds_size + slices_size + 2 * above_size + transitions_size, 1);
+	waterfall->arena = arena;
+	waterfall->energy = (db_t *) arena;
+	colours = (db_t *) (arena + energy_size);
+	decodes = (morse_decode_t *) (arena + energy_size + colours_size);
+	text = arena + energy_size + colours_size + decodes_size;
+	fists = (struct morse_fist_struct *) (arena + energy_size + colours_size + decodes_size + text_size);
+	waterfall->levels = (atomic_uint *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size);
+	waterfall->floors = (atomic_uint *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size);
+	waterfall->transition_counts = (atomic_uint *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size);
+	waterfall->thresholds = (db_t *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size);
+	waterfall->slices = (db_t *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size + thresholds_size);
+	waterfall->above = (unsigned long long *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size + thresholds_size + slices_size);
+	waterfall->crossed = (unsigned long long *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size + thresholds_size + slices_size + above_size);
+	waterfall->transitions = (unsigned int *) (arena + energy_size + colours_size + decodes_size + text_size + fists_size + levels_size + floors_size + transition_counts_size + thresholds_size + slices_size + 2 * above_size);
+
+	fist = morse_fist();
+
 	for(i = 0; i < waterfall->subchannels; i++)
 	{
 		c = waterfall->channels + i;
 
-		c->fist = morse_fist();
-		c->colours = (db_t *) calloc(waterfall->samples, sizeof(db_t));
-		c->decodes = (morse_decode_t *) calloc(waterfall->samples, sizeof(morse_decode_t));
-		c->inputs = (db_t *) calloc(waterfall->samples, sizeof(db_t));
-		c->text = (char *) calloc(waterfall->rows * waterfall->cols, sizeof(char));
+		c->fist = fists + i;
+		*c->fist = *fist;
+		c->colours = colours + (size_t) i * samples;
+		c->decodes = decodes + (size_t) i * samples;
+		c->text = text + (size_t) i * rows * cols;
 		c->start = waterfall->samples;
+		c->idle = 1;
 	}
 
+	morse_fist_dlete(fist);
+
 //	waterfall->working_fist = morse_fist();
 
 	return(waterfall);
 }
 
+/*
+ * Active if the WAKEth latest crossing is recent.  The count is read before
+ * head, so head is at least the row of any crossing it counts.
+ */
+static int waterfall_active(waterfall_t waterfall, int channel)
+{
+	unsigned int count = atomic_load_explicit(waterfall->transition_counts + channel, memory_order_acquire);
+	unsigned int head = atomic_load_explicit(&waterfall->head, memory_order_acquire);
+
+
+	if(count < WATERFALL_ACTIVITY_WAKE) return(0);
+
+	return(head - waterfall->transitions[(size_t) channel * WATERFALL_TRANSITIONS + ((count - WATERFALL_ACTIVITY_WAKE) & (WATERFALL_TRANSITIONS - 1))] <= WATERFALL_ACTIVITY_ROWS);
+}
+
+/*
+ * choose how the input is divided into channels
+ *
+ * The sliding DFT gives an energy sample every hop input samples, at a cost
+ * per input sample proportional to the channel count, windowed in the
+ * frequency domain.  Blocks are always unwindowed with a hop of one block.
+ * The polyphase filterbank has a hop of one block, and the window shapes
+ * its sinc prototype filter.
+ */
+int waterfall_channeliser_set(waterfall_t waterfall, waterfall_channeliser_t channeliser, int hop, waterfall_window_t window)
+{
+	double *prototype = 0, x, sum;
+	int i, bins, blocksize, taps, values;
+
+
+	if(!waterfall || channeliser < 0 || channeliser >= WATERFALL_CHANNELISER_COUNT || window < 0 || window >= WATERFALL_WINDOW_COUNT) return(-1);
+
+	blocksize = 1 << waterfall->input_sampling_power_of_two;
+
+	if(channeliser == WATERFALL_CHANNELISER_BLOCK)
+	{
+		hop = blocksize;
+		window = WATERFALL_WINDOW_NONE;
+	}
+	else if(channeliser == WATERFALL_CHANNELISER_POLYPHASE)
+	{
+		hop = blocksize;
+	}
+	else if(hop <= 0 || hop > blocksize)
+	{
+		return(-1);
+	}
+
+	waterfall->channeliser = channeliser;
+	waterfall->window = window;
+	waterfall->hop = hop;
+	waterfall->hop_count = 0;
+	waterfall->buffer_count = 0;
+	bzero(waterfall->buffer, waterfall->format->values * blocksize * sizeof(waterfall_input_t));
+
+	if(channeliser == WATERFALL_CHANNELISER_SLIDING)
+	{
+		bins = waterfall->subchannels + 2 * WATERFALL_SLIDING_SKIRT;
+
+		if(!waterfall->sliding)
+		{
+			waterfall->sliding = (struct waterfall_sliding_struct *) simd_calloc(bins, sizeof(struct waterfall_sliding_struct));
+			waterfall->sliding_twiddles = (struct waterfall_sliding_struct *) simd_calloc(bins, sizeof(struct waterfall_sliding_struct));
+		}
+
+		bzero(waterfall->sliding, bins * sizeof(struct waterfall_sliding_struct));
+
+// the damping is folded into the twiddles
+		waterfall->damping = pow(WATERFALL_SLIDING_DAMPING, 1.0 / blocksize);
+
+		for(i = 0; i < bins; i++)
+		{
+			waterfall->sliding_twiddles[i].real = waterfall->damping * cos((2.0 * M_PI * (waterfall->first_subchannel - WATERFALL_SLIDING_SKIRT + i)) / blocksize);
+			waterfall->sliding_twiddles[i].imag = waterfall->damping * sin((2.0 * M_PI * (waterfall->first_subchannel - WATERFALL_SLIDING_SKIRT + i)) / blocksize);
+		}
+	}
+	else if(channeliser == WATERFALL_CHANNELISER_POLYPHASE)
+	{
+		taps = blocksize * WATERFALL_POLYPHASE_TAPS;
+// the filter is laid out like the history, so complex input has each tap twice
+		values = waterfall->format->values;
+
+		if(!waterfall->polyphase_filter)
+		{
+			waterfall->polyphase_filter = (signed short *) simd_calloc(taps * values, sizeof(signed short));
+			waterfall->polyphase_sum = (int *) simd_calloc(blocksize * values, sizeof(int));
+			waterfall->polyphase_history = (waterfall_input_t *) simd_calloc(taps * values, sizeof(waterfall_input_t));
+			waterfall->polyphase_output = (signed short *) simd_calloc(blocksize, sizeof(signed short));
+		}
+
+		bzero(waterfall->polyphase_history, taps * values * sizeof(waterfall_input_t));
+		waterfall->polyphase_block = 0;
+
+// one channel wide sinc, windowed, with the same gain as a block
+		prototype = (double *) calloc(taps, sizeof(double));
+		sum = 0;
+
+		for(i = 0; i < taps; i++)
+		{
+			x = (i - (taps - 1) / 2.0) / blocksize;
+			prototype[i] = x ? sin(M_PI * x) / (M_PI * x) : 1.0;
+
+			switch(window)
+			{
+			case WATERFALL_WINDOW_HANN:
+				prototype[i] *= 0.5 - 0.5 * cos((2.0 * M_PI * (i + 0.5)) / taps);
+				break;
+
+			case WATERFALL_WINDOW_BLACKMAN:
+				prototype[i] *= 0.42 - 0.5 * cos((2.0 * M_PI * (i + 0.5)) / taps) + 0.08 * cos((4.0 * M_PI * (i + 0.5)) / taps);
+				break;
+
+			default:
+				break;
+			}
+
+			sum += prototype[i];
+		}
+
+		for(i = 0; i < taps; i++)
+		{
+			waterfall->polyphase_filter[i * values] = lround((prototype[i] * blocksize * (1 << WATERFALL_POLYPHASE_BITS)) / sum);
+			if(values > 1) waterfall->polyphase_filter[i * values + 1] = waterfall->polyphase_filter[i * values];
+		}
+
+		free(prototype);
+	}
+
+	return(0);
+}
+
 void waterfall_clear(waterfall_t waterfall, int subchannel)
 {
 	struct waterfall_channel_struct *c = 0;
@@ -172,6 +481,7 @@ void waterfall_clear(waterfall_t waterfall, int subchannel)
 	bzero(c->text, waterfall->rows * waterfall->cols * sizeof(char));
 	
 	c->text_end = 0;
+	c->version++;
 }
 
 const db_t *waterfall_colours(waterfall_t waterfall, int subchannel)
@@ -183,100 +493,107 @@ const db_t *waterfall_colours(waterfall_t waterfall, int subchannel)
 
 	c = waterfall->channels + subchannel - waterfall->first_subchannel;
 
+// a copy, for callers that need one, waterfall_view reads in place
+	while(!waterfall_history(waterfall, subchannel - waterfall->first_subchannel, atomic_load_explicit(&waterfall->head, memory_order_acquire), waterfall->samples, c->colours))
+		;
+
 	return(c->colours);
 }
-static void waterfall_cos12_start(void)
+void waterfall_dlete(waterfall_t waterfall)
 {
-	int i, *cos_array = 0;
+	if(waterfall->arena)
+	{
+		free(waterfall->arena);
+		waterfall->arena = 0;
+	}
 
+	if(waterfall->buffer)
+	{
+		free(waterfall->buffer);
+		waterfall->buffer = 0;
+	}
 
-	if(cos12) return;
-	
-	cos_array = (int *) calloc(1 << FFT_COS12_TABLE_BITS, sizeof(int));
+	if(waterfall->fft)
+	{
+		fft_dlete(waterfall->fft);
+		waterfall->fft = 0;
+	}
 
-	for(i = 0; i < (1 << FFT_COS12_TABLE_BITS); i++)
+	if(waterfall->bins)
 	{
-		cos_array[i] = 0x0FFF * cos((2.0 * M_PI * i) / (1 << FFT_COS12_TABLE_BITS));
+		free(waterfall->bins);
+		waterfall->bins = 0;
 	}
 
-	cos12 = cos_array;
-}
+	if(waterfall->sliding)
+	{
+		free(waterfall->sliding);
+		waterfall->sliding = 0;
+	}
 
-void waterfall_dlete(waterfall_t waterfall)
-{
-	struct waterfall_channel_struct *c = 0;
-	int i;
+	if(waterfall->sliding_twiddles)
+	{
+		free(waterfall->sliding_twiddles);
+		waterfall->sliding_twiddles = 0;
+	}
 
+	if(waterfall->polyphase_filter)
+	{
+		free(waterfall->polyphase_filter);
+		waterfall->polyphase_filter = 0;
+	}
 
-	for(i = 0; i < waterfall->subchannels; i++)
+	if(waterfall->polyphase_sum)
 	{
-		c = waterfall->channels + i;
+		free(waterfall->polyphase_sum);
+		waterfall->polyphase_sum = 0;
+	}
 
-		if(c->fist)
-		{
-			morse_fist_dlete(c->fist);
-			c->fist = 0;
-		}
+	if(waterfall->polyphase_history)
+	{
+		free(waterfall->polyphase_history);
+		waterfall->polyphase_history = 0;
+	}
 
-		if(c->colours)
-		{
-			free(c->colours);
-			c->colours = 0;
-		}
+	if(waterfall->polyphase_output)
+	{
+		free(waterfall->polyphase_output);
+		waterfall->polyphase_output = 0;
+	}
 
-		if(c->inputs)
-		{
-			free(c->inputs);
-			c->inputs = 0;
-		}
+	free(waterfall);
+}
 
-		if(c->decodes)
-		{
-			free(c->decodes);
-			c->decodes = 0;
-		}
+// gathers a channel's count energy values before row head, oldest first,
+// and returns 0 if the DSP may have overwritten any of them meanwhile
+static int waterfall_history(waterfall_t waterfall, int channel, unsigned int head, int count, db_t *output)
+{
+	unsigned int row = head - count;
+	int i;
 
-		if(c->text)
-		{
-			free(c->text);
-			c->text = 0;
-		}
-	}
 
-	if(waterfall->buffer)
+	for(i = 0; i < count; i++, row++)
 	{
-		free(waterfall->buffer);
-		waterfall->buffer = 0;
+		output[i] = waterfall_row(waterfall, row)[channel];
 	}
 
-	free(waterfall);
+	return(waterfall_unwritten(waterfall, head, count));
 }
 
-static db_t waterfall_fft_row(const waterfall_input_t *in, int logcount, int row)
+// the channel's threshold from the levels of its last samples rows
+static db_t waterfall_levels(waterfall_t waterfall, int channel, int *bimodality)
 {
-	register const waterfall_input_t *in_ptr = in;
-	register int angle;
-	long long rl = 0, im = 0;
+	unsigned int histogram[MORSE_LEVELS];
+	const atomic_uint *levels = waterfall->levels + (size_t) channel * MORSE_LEVELS;
 	int i;
-	db_integer_t ret;
 
 
-	for(i = (1 << logcount) - 1; i; i--)
+	for(i = 0; i < MORSE_LEVELS; i++)
 	{
-		angle = (0x0FFF * row * i) >> logcount;
-#if defined(WATERFALL_COMPLEX_INPUT)
-		rl += in_ptr->real * COS12(angle) - in_ptr->imag * SIN12(angle);
-		im += in_ptr->imag * COS12(angle) + in_ptr->real * SIN12(angle);
-#else
-		rl += *(in_ptr) * COS12(angle);
-		im += *(in_ptr) * SIN12(angle);
-#endif
-		in_ptr++;
+		histogram[i] = atomic_load_explicit(levels + i, memory_order_relaxed);
 	}
 
-	ret = (rl * rl + im * im) >> (2 * logcount + 2 * FFT_COS12_TABLE_BITS);
-
-	return(db_from_integer(ret));
+	return(morse_threshold(histogram, 0, 0, bimodality));
 }
 
 const morse_fist_t waterfall_fist(waterfall_t waterfall, int subchannel)
@@ -293,6 +610,79 @@ const morse_fist_t waterfall_fist(waterfall_t waterfall, int subchannel)
 	return(c->fist);
 }
 
+/*
+ * Idle channels cost nothing to sync, so they are synced here and never put
+ * off, and only keyed channels and the focus are ranked, best first.
+ */
+static int waterfall_rank(waterfall_t waterfall, int focus, struct waterfall_rank_struct *ranks)
+{
+	struct waterfall_channel_struct *c = 0;
+	unsigned int head = atomic_load_explicit(&waterfall->head, memory_order_acquire);
+	int i, bimodality, ret = 0;
+
+
+	for(i = 0; i < waterfall->subchannels; i++)
+	{
+		c = waterfall->channels + i;
+
+		if(i == focus - waterfall->first_subchannel)
+		{
+			ranks[ret].priority = UINT_MAX;
+		}
+		else if(waterfall_active(waterfall, i))
+		{
+// from the DSP's levels, as one just woken has never been decoded to have any
+			waterfall_levels(waterfall, i, &bimodality);
+			ranks[ret].priority = bimodality + ((head - c->synced) >> WATERFALL_SCHEDULE_STALE_SHIFT);
+		}
+		else
+		{
+			waterfall_sync(waterfall, waterfall->first_subchannel + i);
+			c->deferred = 0;
+			continue;
+		}
+
+		ranks[ret++].channel = i;
+	}
+
+	qsort(ranks, ret, sizeof(*ranks), waterfall_rank_compare);
+
+	return(ret);
+}
+
+// best first, and lower channels first among equals so a round is repeatable
+static int waterfall_rank_compare(const void *a, const void *b)
+{
+	const struct waterfall_rank_struct *rank_a = (const struct waterfall_rank_struct *) a;
+	const struct waterfall_rank_struct *rank_b = (const struct waterfall_rank_struct *) b;
+
+
+	if(rank_a->priority != rank_b->priority) return(rank_a->priority < rank_b->priority ? 1 : -1);
+
+	return(rank_a->channel - rank_b->channel);
+}
+
+static inline db_t *waterfall_row(waterfall_t waterfall, unsigned int row)
+{
+	return(waterfall->energy + (size_t) (row & (waterfall->history_size - 1)) * waterfall->subchannels);
+}
+
+int waterfall_schedule(waterfall_t waterfall, int subchannel, waterfall_schedule_t *schedule)
+{
+	struct waterfall_channel_struct *c = 0;
+
+
+	if(subchannel < waterfall->first_subchannel || subchannel >= waterfall->first_subchannel + waterfall->subchannels) return(-1);
+
+	c = waterfall->channels + subchannel - waterfall->first_subchannel;
+
+	schedule->deferred = c->deferred;
+	schedule->deferrals = c->deferrals;
+	schedule->latency = c->latency;
+
+	return(0);
+}
+
 int waterfall_start(waterfall_t waterfall, int subchannel)
 {
 	struct waterfall_channel_struct *c = 0;
@@ -317,26 +707,67 @@ const morse_decode_t *waterfall_symbols(waterfall_t waterfall, int subchannel)
 	return(c->decodes);
 }
 
+/*
+ * Decoding works from the channel's crossings of the DSP's threshold, not
+ * its energy, so a sync costs the marks and spaces since the last one
+ * however many rows they span.  crossings counts those before the row
+ * synced, and the state at synced is which side of the last of them it is.
+ */
 int waterfall_sync(waterfall_t waterfall, int subchannel)
 {
 	struct waterfall_channel_struct *c = 0;
-	unsigned int threshold, onoff_count, updates;
-	int i;
+	unsigned int rows[WATERFALL_TRANSITIONS], onoff_count, head, first, start;
+	morse_time_t runs[WATERFALL_TRANSITIONS + 1];
+	int i, count, runs_size, channel;
 
 
 	if(subchannel < waterfall->first_subchannel || subchannel >= waterfall->first_subchannel + waterfall->subchannels) return(0);
 	
-	threshold = db_from_integer(waterfall->average) + WATERFALL_THRESHOLD_DB;
+	channel = subchannel - waterfall->first_subchannel;
+	c = waterfall->channels + channel;
+	head = atomic_load_explicit(&waterfall->head, memory_order_acquire);
+	c->latency = head - c->synced;
+
+// channels without keying aren't decoded at all, and start again with the
+// whole window as soon as it appears
+	if(!waterfall_active(waterfall, channel))
+	{
+		if(!c->idle)
+		{
+			bzero(c->decodes, waterfall->samples * sizeof(*c->decodes));
+			c->idle = 1;
+			c->version++;
+		}
+		c->synced = head;
+		return(0);
+	}
 
-	c = waterfall->channels + subchannel - waterfall->first_subchannel;
-	
-	if(c->updates)
+	if(c->synced != head || c->idle)
 	{
 		do
 		{
-			updates = c->updates;
+// the count is read after head, so it has every crossing before head, and
+// any from head on are dropped until the next sync
+			first = c->crossings;
+			count = waterfall_crossings(waterfall, channel, &first, rows, ARRAY_SIZE(rows));
+			while(count > 0 && (int) (rows[count - 1] - head) >= 0) count--;
+
+// once woken, or so far behind that crossings were lost, it starts again from
+// the first mark still held in the window
+			if(c->idle || first != c->crossings)
+			{
+				bzero(c->decodes, waterfall->samples * sizeof(*c->decodes));
+				c->idle = 0;
 
-			memmove(c->colours, c->inputs, waterfall->samples * sizeof(*c->colours));
+				for(i = 0; i < count && (((first + i) & 1) || (int) (rows[i] - (head - waterfall->samples)) < 0); i++)
+					;
+				first += i;
+				count -= i;
+				memmove(rows, rows + i, count * sizeof(*rows));
+
+				c->synced = count ? rows[0] : head;
+				c->crossings = first;
+			}
 			
 			while(waterfall_text_lines(waterfall, subchannel) >= waterfall->rows)
 			{
@@ -349,15 +780,21 @@ int waterfall_sync(waterfall_t waterfall, int subchannel)
 				c->text_end -= i + 1;
 			}
 
+// a run up to each crossing, and one from the last up to head, starting on a
+// mark if an odd number of crossings went before
+			for(i = 0, runs_size = 0, start = c->synced; i < count; i++)
+			{
+				runs[runs_size++] = rows[i] - start;
+				start = rows[i];
+			}
+			runs[runs_size++] = head - start;
 
-			c->threshold = threshold;
-
-			onoff_count = morse_decode(c->decodes, waterfall->samples, updates, c->colours + waterfall->samples - updates, updates, c->threshold, c->fist);
+			onoff_count = morse_decode_runs(c->decodes, waterfall->samples, runs, runs_size, c->crossings & 1, c->fist);
 			
 			if(onoff_count < WATERFALL_THRESHOLD_ONOFF)
 			{
 				bzero(c->fist, sizeof(*c->fist));
-				onoff_count = morse_decode(c->decodes, waterfall->samples, 0, c->colours + waterfall->samples - updates, 0, c->threshold, c->fist);
+				onoff_count = morse_decode_runs(c->decodes, waterfall->samples, 0, 0, 0, c->fist);
 			}
 			
 			if(onoff_count < WATERFALL_THRESHOLD_ONOFF)
@@ -366,6 +803,7 @@ int waterfall_sync(waterfall_t waterfall, int subchannel)
 				{
 					c->decodes[i].text = 0;
 					c->decodes[i].whitespace = 0;
+					c->decodes[i].committed = 0;
 				}
 				c->text[c->text_end] = 0;
 			}
@@ -375,14 +813,96 @@ int waterfall_sync(waterfall_t waterfall, int subchannel)
 				c->text_end += morse_trim_age(c->decodes, waterfall->samples, waterfall->samples);
 			}
 
-			c->updates -= updates;
+			c->crossings = first + count;
+			c->synced = head;
+			head = atomic_load_explicit(&waterfall->head, memory_order_acquire);
 		}
-		while(c->updates);
+		while(c->synced != head);
+
+		c->version++;
 	}
 	
 	return(0);
 }
 
+/*
+ * A channel's sync touches nothing but that channel, so with each channel
+ * synced by exactly one thread, whichever ends up with it, no locking is
+ * needed.
+ */
+void waterfall_sync_all(waterfall_t waterfall, pool_t pool)
+{
+	if(!waterfall) return;
+
+	pool_run(pool, waterfall_sync_range, waterfall, waterfall->subchannels);
+}
+
+/*
+ * Each thread takes the best channel left until there are none, so the best
+ * are synced first however many threads there are.  Once the deadline has
+ * passed what is left is only counted as deferred, apart from the first,
+ * which keeps the focus decoding however late the round starts.
+ */
+void waterfall_sync_budget(waterfall_t waterfall, pool_t pool, int focus, long budget_usec)
+{
+	struct waterfall_round_struct round;
+
+
+	if(!waterfall) return;
+
+	round.waterfall = waterfall;
+	round.ranks = (struct waterfall_rank_struct *) calloc(waterfall->subchannels, sizeof(struct waterfall_rank_struct));
+	round.ranked = waterfall_rank(waterfall, focus, round.ranks);
+	round.deadline = budget_usec > 0 ? waterfall_usec() + budget_usec : 0;
+	atomic_init(&round.next, 0);
+
+// an item for each ranked channel, but each is whichever is best when a
+// thread gets to it, not a fixed one
+	pool_run(pool, waterfall_sync_ranked, &round, round.ranked);
+
+	free(round.ranks);
+}
+
+static void waterfall_sync_range(void *blob, int first, int last)
+{
+	waterfall_t waterfall = (waterfall_t) blob;
+	int i;
+
+
+	for(i = first; i < last; i++)
+	{
+		waterfall_sync(waterfall, waterfall->first_subchannel + i);
+	}
+}
+
+static void waterfall_sync_ranked(void *blob, int first, int last)
+{
+	struct waterfall_round_struct *round = (struct waterfall_round_struct *) blob;
+	waterfall_t waterfall = round->waterfall;
+	struct waterfall_channel_struct *c = 0;
+	int i, channel;
+
+
+	for(; first < last; first++)
+	{
+		i = atomic_fetch_add_explicit(&round->next, 1, memory_order_relaxed);
+		channel = round->ranks[i].channel;
+		c = waterfall->channels + channel;
+
+// one that has gone idle since it was ranked is still cheap to sync
+		if(i && round->deadline && waterfall_active(waterfall, channel) && waterfall_usec() > round->deadline)
+		{
+			c->deferred++;
+			c->deferrals++;
+		}
+		else
+		{
+			waterfall_sync(waterfall, waterfall->first_subchannel + channel);
+			c->deferred = 0;
+		}
+	}
+}
+
 const char *waterfall_text(waterfall_t waterfall, int subchannel)
 {
 	struct waterfall_channel_struct *c = 0;
@@ -419,115 +939,455 @@ int waterfall_text_lines(waterfall_t waterfall, int subchannel)
 	return(ret);
 }
 
-void waterfall_update(waterfall_t waterfall, const waterfall_input_t *input, int input_count)
+/*
+ * Crossings are numbered from the channel's first, which is onto a mark, so
+ * they alternate with the even ones onto marks.  Rows only go up, so those
+ * from since on are the newest.
+ */
+int waterfall_transitions(waterfall_t waterfall, int subchannel, unsigned int since, waterfall_transition_t *transitions, int size)
 {
-	struct waterfall_channel_struct *c = 0;
-	int i, subchannel, blocksize, sample_count = 0; //, characters = waterfall->rows * waterfall->cols, onoff_count;
-	db_integer_t threshold = 0;
+	unsigned int rows[WATERFALL_TRANSITIONS], first, count;
+	int channel, ret = 0, i;
 
 
-	if(!waterfall || !input || input_count <= 0) return;
+	if(subchannel < waterfall->first_subchannel || subchannel >= waterfall->first_subchannel + waterfall->subchannels || size < 0) return(-1);
 
-	blocksize = 1 << waterfall->input_sampling_power_of_two;
+	channel = subchannel - waterfall->first_subchannel;
 
-	if(waterfall->buffer_count)
+	count = atomic_load_explicit(waterfall->transition_counts + channel, memory_order_relaxed);
+	first = count > (unsigned int) size ? count - size : 0;
+	count = waterfall_crossings(waterfall, channel, &first, rows, size < (int) ARRAY_SIZE(rows) ? size : (int) ARRAY_SIZE(rows));
+
+	for(i = 0; i < (int) count; i++)
 	{
-		if(waterfall->buffer_count < blocksize)
-		{
-			i = input_count;
-			if(i > blocksize - waterfall->buffer_count)
-			{
-				i = blocksize - waterfall->buffer_count;
-			}
-			memmove(waterfall->buffer + waterfall->buffer_count, input, i * sizeof(waterfall_input_t));
-			input += i;
-			input_count -= i;
-		}
+		if((int) (rows[i] - since) < 0) continue;
 
-		if(waterfall->samples == blocksize)
-		{
-			waterfall_update_block(waterfall, waterfall->buffer);
-			sample_count++;
-		}
+		transitions[ret].row = rows[i];
+		transitions[ret].mark = !((first + i) & 1);
+		ret++;
 	}
 
-	while(input_count >= blocksize)
+	return(ret);
+}
+
+/*
+ * copies the rows of a channel's crossings numbered *first on, at most size
+ * of them, oldest first
+ *
+ * The DSP writes the slot of crossing count before it publishes count + 1,
+ * and that is the slot of the oldest, count - WATERFALL_TRANSITIONS, so it
+ * is as good as lost already.  Any the DSP comes round to while they are
+ * copied are dropped from the front, and *first is moved on past whatever
+ * is lost.
+ */
+static int waterfall_crossings(waterfall_t waterfall, int channel, unsigned int *first, unsigned int *rows, int size)
+{
+	const unsigned int *ring = waterfall->transitions + (size_t) channel * WATERFALL_TRANSITIONS;
+	unsigned int count, kept, i;
+	int ret = 0;
+
+
+	count = atomic_load_explicit(waterfall->transition_counts + channel, memory_order_acquire);
+	kept = count > WATERFALL_TRANSITIONS - 1 ? count - (WATERFALL_TRANSITIONS - 1) : 0;
+	if((int) (kept - *first) > 0) *first = kept;
+
+	for(i = *first; i != count && ret < size; i++, ret++)
 	{
-		waterfall_update_block(waterfall, input);
-		sample_count++;
-		input += blocksize;
-		input_count -= blocksize;
+		rows[ret] = ring[i & (WATERFALL_TRANSITIONS - 1)];
 	}
 
-	if(input_count)
+	atomic_thread_fence(memory_order_acquire);
+	count = atomic_load_explicit(waterfall->transition_counts + channel, memory_order_relaxed);
+	kept = count > WATERFALL_TRANSITIONS - 1 ? count - (WATERFALL_TRANSITIONS - 1) : 0;
+	if((int) (kept - *first) > 0)
 	{
-		memmove(waterfall->buffer, input, input_count * sizeof(waterfall_input_t));
+		i = kept - *first < (unsigned int) ret ? kept - *first : (unsigned int) ret;
+		memmove(rows, rows + i, (ret - i) * sizeof(*rows));
+		ret -= i;
+		*first = kept;
 	}
 
-	if(sample_count)
+	return(ret);
+}
+
+/*
+ * The DSP writes row head before it publishes head + 1, so a reader of the
+ * rows before head is only at risk once the DSP comes round the ring to them.
+ */
+static int waterfall_unwritten(waterfall_t waterfall, unsigned int head, int count)
+{
+	atomic_thread_fence(memory_order_acquire);
+
+	return(atomic_load_explicit(&waterfall->head, memory_order_relaxed) - head < (unsigned int) (waterfall->history_size - count));
+}
+
+static long long waterfall_usec(void)
+{
+	struct timespec now;
+
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return((long long) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+void waterfall_update(waterfall_t waterfall, const waterfall_input_t *input, int input_count)
+{
+	int i, blocksize, values;
+
+
+	if(!waterfall || !input || input_count <= 0) return;
+
+	if(waterfall->channeliser == WATERFALL_CHANNELISER_SLIDING)
 	{
-		threshold = 0;
+		waterfall->format->update_sliding(waterfall, input, input_count);
+		return;
+	}
 
-		for(subchannel = 0; subchannel < waterfall->subchannels; subchannel++)
+	blocksize = 1 << waterfall->input_sampling_power_of_two;
+	values = waterfall->format->values;
+
+	if(waterfall->buffer_count)
+	{
+		i = input_count;
+		if(i > blocksize - waterfall->buffer_count)
+		{
+			i = blocksize - waterfall->buffer_count;
+		}
+		memmove(waterfall->buffer + waterfall->buffer_count * values, input, i * values * sizeof(waterfall_input_t));
+		waterfall->buffer_count += i;
+		input += i * values;
+		input_count -= i;
+
+		if(waterfall->buffer_count == blocksize)
 		{
-			c = waterfall->channels + subchannel;
+			waterfall->format->update_block(waterfall, waterfall->buffer);
+			waterfall->buffer_count = 0;
+		}
+	}
+
+	while(input_count >= blocksize)
+	{
+		waterfall->format->update_block(waterfall, input);
+		input += blocksize * values;
+		input_count -= blocksize;
+	}
+
+	if(input_count)
+	{
+		memmove(waterfall->buffer, input, input_count * values * sizeof(waterfall_input_t));
+		waterfall->buffer_count = input_count;
+	}
+}
+
+static void waterfall_update_block_complex(waterfall_t waterfall, const waterfall_input_t *block)
+{
+	waterfall_update_block_format(waterfall, block, WATERFALL_FORMAT_COMPLEX);
+}
+
+// inlined into a copy for each format, so the format tests fold away
+__attribute__((always_inline))
+static inline void waterfall_update_block_format(waterfall_t waterfall, const waterfall_input_t *block, const waterfall_format_t format)
+{
+	db_t *row;
+	const db_t *expired;
+	unsigned int head;
+	int i, bin, shift, blocksize = (1 << waterfall->input_sampling_power_of_two);
 
-			for(i = 0; i < waterfall->samples; i++)
+
+// one transform gives every bin of the block
+	if(waterfall->channeliser == WATERFALL_CHANNELISER_POLYPHASE)
+	{
+		shift = waterfall_update_polyphase_format(waterfall, block, format);
+	}
+	else
+	{
+		if(format == WATERFALL_FORMAT_COMPLEX)
+		{
+			for(i = 0; i < blocksize; i++)
 			{
-				if(c->inputs[i] > threshold) threshold = c->inputs[i];
+				waterfall->bins[i].real = block[2 * i];
+				waterfall->bins[i].imag = block[2 * i + 1];
 			}
+			fft_complex(waterfall->fft, waterfall->bins);
 		}
+		else
+		{
+			fft_real(waterfall->fft, block, waterfall->bins);
+		}
+		shift = 2 * waterfall->input_sampling_power_of_two;
+	}
+
+	head = atomic_load_explicit(&waterfall->head, memory_order_relaxed);
+	row = waterfall_row(waterfall, head);
+	expired = head >= (unsigned int) waterfall->samples ? waterfall_row(waterfall, head - waterfall->samples) : 0;
+	for(i = 0; i < waterfall->subchannels; i++)
+	{
+// negative channels wrap to the top of the complex spectrum
+		bin = (i + waterfall->first_subchannel) & (blocksize - 1);
 
-//fprintf(stderr, "waterfall->threshold=%d\n", (int) waterfall->threshold);
+		waterfall_update_channel(waterfall, row, expired, i, db_from_integer(FFT_POW2(waterfall->bins[bin]) >> shift));
 	}
+	waterfall_update_row(waterfall, row, head);
+	atomic_store_explicit(&waterfall->head, head + 1, memory_order_release);
 }
 
-static db_integer_t waterfall_update_block(waterfall_t waterfall, const waterfall_input_t *block)
+static void waterfall_update_block_real(waterfall_t waterfall, const waterfall_input_t *block)
 {
-	struct waterfall_channel_struct *c = 0;
-	db_integer_t ret = 0;
-	int i, blocksize = (1 << waterfall->input_sampling_power_of_two);
+	waterfall_update_block_format(waterfall, block, WATERFALL_FORMAT_REAL);
+}
+
+// one value of the row being written, the caller moves head on once every channel is done
+static inline void waterfall_update_channel(waterfall_t waterfall, db_t *row, const db_t *expired, int channel, db_t power)
+{
+	atomic_uint *levels = waterfall->levels + (size_t) channel * MORSE_LEVELS;
+	unsigned int floor, step, threshold, x = power * WATERFALL_FLOOR_ONE;
 #if defined(WATERFALL_FILTER_SIZE)
+	struct waterfall_channel_struct *c = waterfall->channels + channel;
+	db_t filtered = 0;
 	int j;
+
+
+	memmove(c->filter, c->filter + 1, (ARRAY_SIZE(c->filter) - 1) * sizeof(*c->filter));
+	c->filter[ARRAY_SIZE(c->filter) - 1] = power;
+	for(j = 0; j < (int) ARRAY_SIZE(c->filter); j++)
+	{
+		filtered = (filtered + (WATERFALL_FILTER_COEFFICIENT - 1) * c->filter[j]) / WATERFALL_FILTER_COEFFICIENT;
+	}
+	power = filtered;
 #endif
 
+	row[channel] = power;
+
+// only the DSP writes the counts, so they need no read-modify-write
+	atomic_store_explicit(levels + power, atomic_load_explicit(levels + power, memory_order_relaxed) + 1, memory_order_relaxed);
+	if(expired)
+	{
+		atomic_store_explicit(levels + expired[channel], atomic_load_explicit(levels + expired[channel], memory_order_relaxed) - 1, memory_order_relaxed);
+	}
+
+// equal steps up and down settle on the median, which is the noise as long
+// as a signal is on less than half the time, and a whole dB a step finds it
+// quickly until the first window is full
+	floor = atomic_load_explicit(waterfall->floors + channel, memory_order_relaxed);
+	step = expired ? WATERFALL_FLOOR_STEP : WATERFALL_FLOOR_ONE;
+	if(x < floor)
+	{
+		floor -= floor - x < step ? floor - x : step;
+	}
+	else
+	{
+		floor += x - floor < step ? x - floor : step;
+	}
+	atomic_store_explicit(waterfall->floors + channel, floor, memory_order_relaxed);
+
+// compared in whole dB by waterfall_update_row, which is exact as power is
+	threshold = (floor + WATERFALL_THRESHOLD_DB * WATERFALL_FLOOR_ONE) / WATERFALL_FLOOR_ONE;
+	if(waterfall->slices[channel]) threshold = waterfall->slices[channel];
+	waterfall->thresholds[channel] = threshold < MORSE_LEVELS ? threshold : MORSE_LEVELS - 1;
+}
+
+/*
+ * The whole row is compared with the thresholds at once, and only channels
+ * whose bit changed cost anything more.  Keying crosses the threshold often,
+ * noise seldom and a carrier never.
+ *
+ * Keyed channels are sliced between their own on and off levels, the rest
+ * just above their noise floor, and the crossings are all the decoder sees,
+ * so the slice is the decoder's.  A share of the channels has its levels
+ * checked each row.
+ */
+static void waterfall_update_row(waterfall_t waterfall, const db_t *row, unsigned int head)
+{
+	unsigned long long word;
+	unsigned int count;
+	int i, channel, bimodality;
+	db_t level;
+
+
+	simd_above_each(waterfall->crossed, row, waterfall->thresholds, waterfall->subchannels);
+
+	for(i = 0; i < (waterfall->subchannels + 63) >> 6; i++)
+	{
+		for(word = waterfall->crossed[i] ^ waterfall->above[i]; word; word &= word - 1)
+		{
+			channel = (i << 6) + __builtin_ctzll(word);
+
+			count = atomic_load_explicit(waterfall->transition_counts + channel, memory_order_relaxed);
+			waterfall->transitions[(size_t) channel * WATERFALL_TRANSITIONS + (count & (WATERFALL_TRANSITIONS - 1))] = head;
+			atomic_store_explicit(waterfall->transition_counts + channel, count + 1, memory_order_release);
+		}
+
+		waterfall->above[i] = waterfall->crossed[i];
+	}
+
+	for(channel = head & (WATERFALL_SLICE_ROWS - 1); channel < waterfall->subchannels; channel += WATERFALL_SLICE_ROWS)
+	{
+		level = waterfall_active(waterfall, channel) ? waterfall_levels(waterfall, channel, &bimodality) : 0;
+		waterfall->slices[channel] = level && bimodality >= WATERFALL_THRESHOLD_BIMODAL ? level : 0;
+	}
+}
+
+/*
+ * weight the last WATERFALL_POLYPHASE_TAPS blocks by the prototype filter,
+ * fold them into one block and transform it
+ *
+ * Real output is halved to fit the transform input, so this returns the
+ * shift that scales the bins' power to match a plain block.
+ */
+__attribute__((always_inline))
+static inline int waterfall_update_polyphase_format(waterfall_t waterfall, const waterfall_input_t *block, const waterfall_format_t format)
+{
+	const signed short *history[WATERFALL_POLYPHASE_TAPS];
+	int i, t, sum, blocksize = (1 << waterfall->input_sampling_power_of_two), values = (format == WATERFALL_FORMAT_COMPLEX) ? 2 : 1;
+
+
+	memmove(waterfall->polyphase_history + waterfall->polyphase_block * blocksize * values, block, blocksize * values * sizeof(waterfall_input_t));
+	waterfall->polyphase_block = (waterfall->polyphase_block + 1) % WATERFALL_POLYPHASE_TAPS;
+
+// oldest block first
+	for(t = 0; t < WATERFALL_POLYPHASE_TAPS; t++)
+	{
+		history[t] = waterfall->polyphase_history + ((waterfall->polyphase_block + t) % WATERFALL_POLYPHASE_TAPS) * blocksize * values;
+	}
+
+	simd_fir(waterfall->polyphase_sum, waterfall->polyphase_filter, blocksize * values, history, WATERFALL_POLYPHASE_TAPS, blocksize * values);
+
+	if(format == WATERFALL_FORMAT_COMPLEX)
+	{
+		for(i = 0; i < blocksize; i++)
+		{
+			waterfall->bins[i].real = waterfall->polyphase_sum[2 * i] >> WATERFALL_POLYPHASE_BITS;
+			waterfall->bins[i].imag = waterfall->polyphase_sum[2 * i + 1] >> WATERFALL_POLYPHASE_BITS;
+		}
+
+		fft_complex(waterfall->fft, waterfall->bins);
+
+		return(2 * waterfall->input_sampling_power_of_two);
+	}
 
 	for(i = 0; i < blocksize; i++)
 	{
-#if defined(WATERFALL_COMPLEX_INPUT)
-		ret += block[i].real * block[i].real + block[i].imag * block[i].imag;
-#else
-		ret += block[i] * block[i] * 2;
-#endif
+		sum = waterfall->polyphase_sum[i] >> (WATERFALL_POLYPHASE_BITS + 1);
+		if(sum > 0x7FFF) sum = 0x7FFF;
+		if(sum < -0x8000) sum = -0x8000;
+		waterfall->polyphase_output[i] = sum;
 	}
 
-	for(i = 0; i < waterfall->subchannels; i++)
+	fft_real(waterfall->fft, waterfall->polyphase_output, waterfall->bins);
+
+	return(2 * waterfall->input_sampling_power_of_two - 2);
+}
+
+static void waterfall_update_sliding_complex(waterfall_t waterfall, const waterfall_input_t *input, int input_count)
+{
+	waterfall_update_sliding_format(waterfall, input, input_count, WATERFALL_FORMAT_COMPLEX);
+}
+
+/*
+ * S(n) = d * W * (S(n-1) + x(n) - d^N * x(n-N)) for each bin, so the cost
+ * of each input sample is proportional to the channel count
+ */
+__attribute__((always_inline))
+static inline void waterfall_update_sliding_format(waterfall_t waterfall, const waterfall_input_t *input, int input_count, const waterfall_format_t format)
+{
+	register waterfall_input_t *delay;
+	struct waterfall_sliding_struct x;
+	float damping_n = WATERFALL_SLIDING_DAMPING;
+	int i, bins = waterfall->subchannels + 2 * WATERFALL_SLIDING_SKIRT, mask = (1 << waterfall->input_sampling_power_of_two) - 1;
+
+
+	for(i = 0; i < input_count; i++)
 	{
-		c = waterfall->channels + i;
-		memmove(c->inputs, c->inputs + 1, (waterfall->samples - 1) * sizeof(*c->inputs));
-#if defined(WATERFALL_FILTER_SIZE)
-		memmove(c->filter, c->filter + 1, (ARRAY_SIZE(c->filter) - 1) * sizeof(*c->filter));
-		c->filter[ARRAY_SIZE(c->filter) - 1] = waterfall_fft_row(block, waterfall->input_sampling_power_of_two, i + waterfall->first_subchannel);
-		c->inputs[waterfall->samples - 1] = 0;
-		for(j = 0; j < (int) ARRAY_SIZE(c->filter); j++)
+		if(format == WATERFALL_FORMAT_COMPLEX)
 		{
-			c->inputs[waterfall->samples - 1] = (c->inputs[waterfall->samples - 1] + (WATERFALL_FILTER_COEFFICIENT - 1) * c->filter[j]) / WATERFALL_FILTER_COEFFICIENT;
+			delay = waterfall->buffer + 2 * waterfall->buffer_count;
+			x.real = input[2 * i] - damping_n * delay[0];
+			x.imag = input[2 * i + 1] - damping_n * delay[1];
+			delay[0] = input[2 * i];
+			delay[1] = input[2 * i + 1];
+		}
+		else
+		{
+			delay = waterfall->buffer + waterfall->buffer_count;
+			x.real = input[i] - damping_n * delay[0];
+			x.imag = 0;
+			delay[0] = input[i];
+		}
+		waterfall->buffer_count = (waterfall->buffer_count + 1) & mask;
+
+		simd_sliding((float *) waterfall->sliding, (const float *) waterfall->sliding_twiddles, x.real, x.imag, bins);
+
+		if(++waterfall->hop_count >= waterfall->hop)
+		{
+			waterfall_update_sliding_hop(waterfall);
 		}
-#else
-		c->inputs[waterfall->samples - 1] = waterfall_fft_row(block, waterfall->input_sampling_power_of_two, i + waterfall->first_subchannel);
-#endif
-		c->updates++;
 	}
-	
-	ret /= (blocksize * waterfall->subchannels);
+}
 
-	waterfall->average = (WATERFALL_THRESHOLD_COEFFICIENT * waterfall->average + ret) / (WATERFALL_THRESHOLD_COEFFICIENT + 1);
+// windows are applied as a convolution of neighbouring bins, normalised to unity gain
+static void waterfall_update_sliding_hop(waterfall_t waterfall)
+{
+	static const float windows[WATERFALL_WINDOW_COUNT][WATERFALL_SLIDING_SKIRT + 1] =
+	{
+		{ 1.0, 0.0, 0.0 },
+		{ 1.0, -0.5, 0.0 },
+		{ 1.0, -0.25 / 0.42, 0.04 / 0.42 },
+	};
+	const float *window = windows[waterfall->window];
+	const struct waterfall_sliding_struct *s;
+	double real, imag, scale = 1 << waterfall->input_sampling_power_of_two;
+	unsigned int head = atomic_load_explicit(&waterfall->head, memory_order_relaxed);
+	db_t *row = waterfall_row(waterfall, head);
+	const db_t *expired = head >= (unsigned int) waterfall->samples ? waterfall_row(waterfall, head - waterfall->samples) : 0;
+	int i;
 
-//fprintf(stderr, "ret=%d,waterfall->average=%d\n", (int) ret, (int) waterfall->average);
 
-	return(ret);
+	for(i = 0; i < waterfall->subchannels; i++)
+	{
+		s = waterfall->sliding + WATERFALL_SLIDING_SKIRT + i;
+
+		real = window[0] * s[0].real + window[1] * (s[-1].real + s[1].real) + window[2] * (s[-2].real + s[2].real);
+		imag = window[0] * s[0].imag + window[1] * (s[-1].imag + s[1].imag) + window[2] * (s[-2].imag + s[2].imag);
+
+		waterfall_update_channel(waterfall, row, expired, i, db_from_integer((db_integer_t) ((real * real + imag * imag) / (scale * scale))));
+	}
+	waterfall_update_row(waterfall, row, head);
+	atomic_store_explicit(&waterfall->head, head + 1, memory_order_release);
+
+	waterfall->hop_count = 0;
 }
 
+static void waterfall_update_sliding_real(waterfall_t waterfall, const waterfall_input_t *input, int input_count)
+{
+	waterfall_update_sliding_format(waterfall, input, input_count, WATERFALL_FORMAT_REAL);
+}
+
+
+unsigned int waterfall_version(waterfall_t waterfall, int subchannel)
+{
+	if(subchannel < waterfall->first_subchannel || subchannel >= waterfall->first_subchannel + waterfall->subchannels) return(0);
+
+	return(waterfall->channels[subchannel - waterfall->first_subchannel].version);
+}
+
+int waterfall_view(waterfall_t waterfall, int subchannel, waterfall_view_t *view)
+{
+	if(!waterfall || !view || subchannel < waterfall->first_subchannel || subchannel >= waterfall->first_subchannel + waterfall->subchannels) return(-1);
+
+	view->energy = waterfall->energy + subchannel - waterfall->first_subchannel;
+	view->stride = waterfall->subchannels;
+	view->samples = waterfall->samples;
+	view->mask = waterfall->history_size - 1;
+	view->head = atomic_load_explicit(&waterfall->head, memory_order_acquire);
+
+	return(0);
+}
+
+int waterfall_view_valid(waterfall_t waterfall, const waterfall_view_t *view)
+{
+	return(waterfall_unwritten(waterfall, view->head, view->samples));
+}
 
 
 #if defined(TEST)
@@ -543,6 +1403,7 @@ static int assert_errors = 0;
 
 #define TEST_STRING_13 "MAJESTIC THIRTEEN"
 #define TEST_STRING_23 "TWENTY THREE SKIDOO"
+#define TEST_STRING_PARIS "PARIS PARIS PARIS PARIS PARIS"
 
 #define TEST_SAMPLES_PER_MIN	((60*6400)/128)
 
@@ -555,14 +1416,24 @@ static int assert_errors = 0;
 #define TEST_SAMPLE_LOG_BLOCK_SIZE	6
 #define TEST_SAMPLE_BLOCK_SIZE		(1 << (TEST_SAMPLE_LOG_BLOCK_SIZE))
 
-int test_encode_string(waterfall_input_t *samples, morse_fist_t fist)
+#define TEST_COS12_TABLE_BITS		12
+
+#define COS12(x)	test_cos12[(x) & ((1 << TEST_COS12_TABLE_BITS) - 1)]
+#define SIN12(x)	COS12((x) - (1 << (TEST_COS12_TABLE_BITS - 2)))
+
+static int test_cos12[1 << TEST_COS12_TABLE_BITS];
+
+int test_encode_string(waterfall_input_t *samples, morse_fist_t fist, waterfall_format_t format)
 {
 	db_t cw13[TEST_SAMPLES_MAX];
 	db_t cw23[TEST_SAMPLES_MAX];
 	int count;
 
 
-	if(!cos12) waterfall_cos12_start();
+	for(count = 0; count < (int) ARRAY_SIZE(test_cos12); count++)
+	{
+		test_cos12[count] = 0x0FFF * cos((2.0 * M_PI * count) / ARRAY_SIZE(test_cos12));
+	}
 	
 	count = morse_encode(cw13, ARRAY_SIZE(cw13), 1, TEST_STRING_13, fist);
 	ASSERT(count < TEST_ONOFF_MAX);
@@ -571,21 +1442,24 @@ int test_encode_string(waterfall_input_t *samples, morse_fist_t fist)
 
 	for(count = 0; count < TEST_SAMPLES_MAX; count++)
 	{
-#if defined(WATERFALL_COMPLEX_INPUT)
-		samples[count].real = ( 1 * cw13[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * COS12((count * 4096 * 13) >> TEST_SAMPLE_LOG_BLOCK_SIZE) 
+		if(format == WATERFALL_FORMAT_COMPLEX)
+		{
+		samples[2 * count] = ( 1 * cw13[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * COS12((count * 4096 * 13) >> TEST_SAMPLE_LOG_BLOCK_SIZE) 
 						 + 100 * COS12((count * 4096 * 19) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
 						 + 2 * cw23[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * COS12((count * 4096 * 23) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
 						 + (random() & 0x00)) >> 15;
-		samples[count].imag = ( 1 * cw13[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * SIN12((count * 4096 * 13) >> TEST_SAMPLE_LOG_BLOCK_SIZE) 
+		samples[2 * count + 1] = ( 1 * cw13[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * SIN12((count * 4096 * 13) >> TEST_SAMPLE_LOG_BLOCK_SIZE) 
 						 + 100 * SIN12((count * 4096 * 19) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
 						 + 2 * cw23[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * SIN12((count * 4096 * 23) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
 						 + (random() & 0x00)) >> 15;
-		ASSERT(samples[count].real < +127);
-		ASSERT(samples[count].real > -127);
-		ASSERT(samples[count].imag < +127);
-		ASSERT(samples[count].imag > -127);
-if(assert_errors) fprintf(stderr, "samples[%d]={%d,%d}\n", count, samples[count].real, samples[count].imag);
-#else
+		ASSERT(samples[2 * count] < +127);
+		ASSERT(samples[2 * count] > -127);
+		ASSERT(samples[2 * count + 1] < +127);
+		ASSERT(samples[2 * count + 1] > -127);
+if(assert_errors) fprintf(stderr, "samples[%d]={%d,%d}\n", count, samples[2 * count], samples[2 * count + 1]);
+		}
+		else
+		{
 		samples[count] = ( 1 * cw13[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * SIN12((count * 4096 * 13) >> TEST_SAMPLE_LOG_BLOCK_SIZE) 
 						 + 100 * COS12((count * 4096 * 19) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
 						 + 2 * cw23[count >> TEST_SAMPLE_LOG_BLOCK_SIZE] * SIN12((count * 4096 * 23) >> TEST_SAMPLE_LOG_BLOCK_SIZE)
@@ -593,12 +1467,146 @@ if(assert_errors) fprintf(stderr, "samples[%d]={%d,%d}\n", count, samples[count]
 		ASSERT(samples[count] < +127);
 		ASSERT(samples[count] > -127);
 if(assert_errors) fprintf(stderr, "samples[%d]=%d\n", count, samples[count]);
-#endif
+		}
 	}
 
 	return(count);
 }
 
+// a tone of half_bin/2 bins for on samples, then silence
+static void test_tone(waterfall_input_t *samples, int count, int half_bin, int on, waterfall_format_t format)
+{
+	int i;
+
+
+	bzero(samples, 2 * count * sizeof(*samples));
+
+	for(i = 0; i < count && i < on; i++)
+	{
+		if(format == WATERFALL_FORMAT_COMPLEX)
+		{
+			samples[2 * i] = 1000 * cos((M_PI * half_bin * i) / TEST_SAMPLE_BLOCK_SIZE);
+			samples[2 * i + 1] = 1000 * sin((M_PI * half_bin * i) / TEST_SAMPLE_BLOCK_SIZE);
+		}
+		else
+		{
+			samples[i] = 1000 * cos((M_PI * half_bin * i) / TEST_SAMPLE_BLOCK_SIZE);
+		}
+	}
+}
+
+// one block of tones of half_bins[i]/2 bins, each with amplitudes[i], which
+// may be 0 for a space
+static void test_tones(waterfall_input_t *samples, const int *half_bins, const int *amplitudes, int tones, waterfall_format_t format)
+{
+	int i, t;
+
+
+	bzero(samples, 2 * TEST_SAMPLE_BLOCK_SIZE * sizeof(*samples));
+
+	for(t = 0; t < tones; t++)
+	{
+		for(i = 0; i < TEST_SAMPLE_BLOCK_SIZE; i++)
+		{
+			if(format == WATERFALL_FORMAT_COMPLEX)
+			{
+				samples[2 * i] += amplitudes[t] * cos((M_PI * half_bins[t] * i) / TEST_SAMPLE_BLOCK_SIZE);
+				samples[2 * i + 1] += amplitudes[t] * sin((M_PI * half_bins[t] * i) / TEST_SAMPLE_BLOCK_SIZE);
+			}
+			else
+			{
+				samples[i] += amplitudes[t] * cos((M_PI * half_bins[t] * i) / TEST_SAMPLE_BLOCK_SIZE);
+			}
+		}
+	}
+}
+
+static waterfall_t test_waterfall(waterfall_format_t format, const waterfall_input_t *samples, int count, waterfall_channeliser_t channeliser, int hop, waterfall_window_t window)
+{
+	waterfall_t w = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+	int i, j, values = (format == WATERFALL_FORMAT_COMPLEX) ? 2 : 1;
+
+
+	ASSERT(!waterfall_channeliser_set(w, channeliser, hop, window));
+
+	for(i = 0; i < count; i += j)
+	{
+		j = random() & 0xFF;
+
+		if(i + j > count)
+		{
+			j = count - i;
+		}
+
+		waterfall_update(w, samples + i * values, j);
+	}
+
+	for(i = 12; i <= 24; i++)
+	{
+		waterfall_sync(w, i);
+	}
+
+	return(w);
+}
+
+// channels within range of the strongest, for the last energy sample
+static int test_count_channels(waterfall_t w, db_t range)
+{
+	db_t strongest = 0;
+	int i, ret = 0;
+
+
+	for(i = 12; i <= 24; i++)
+	{
+		if(waterfall_colours(w, i)[TEST_WATERFALL_SAMPLES - 1] > strongest) strongest = waterfall_colours(w, i)[TEST_WATERFALL_SAMPLES - 1];
+	}
+
+	for(i = 12; i <= 24; i++)
+	{
+		if(waterfall_colours(w, i)[TEST_WATERFALL_SAMPLES - 1] + range >= strongest) ret++;
+	}
+
+	return(ret);
+}
+
+// a channel's noise floor in whole dB
+static db_t test_floor(waterfall_t waterfall, int channel)
+{
+	return((atomic_load_explicit(waterfall->floors + channel, memory_order_relaxed) + WATERFALL_FLOOR_ONE / 2) / WATERFALL_FLOOR_ONE);
+}
+
+static int test_count_above(const db_t *colours, db_t threshold)
+{
+	int i, ret = 0;
+
+
+	for(i = 0; i < TEST_WATERFALL_SAMPLES; i++)
+	{
+		if(colours[i] > threshold) ret++;
+	}
+
+	return(ret);
+}
+
+// field by field, as the padding of copied symbols can differ
+static int test_same_symbols(const morse_decode_t *a, const morse_decode_t *b)
+{
+	int i;
+
+
+	for(i = 0; i < TEST_WATERFALL_SAMPLES; i++)
+	{
+		if(a[i].age != b[i].age || a[i].mark != b[i].mark || a[i].space != b[i].space
+		|| a[i].snr != b[i].snr || a[i].text != b[i].text || a[i].whitespace != b[i].whitespace
+		|| a[i].committed != b[i].committed)
+		{
+			return(0);
+		}
+	}
+
+	return(1);
+}
+
 void test_print_colours(db_t *samples, int length)
 {
 	int i;
@@ -660,50 +1668,401 @@ void test_print_symbols(int start, const morse_decode_t *symbols, int length)
 
 int main(void)
 {
-	morse_fist_t fist = morse_fist();
-	waterfall_input_t samples[TEST_SAMPLES_MAX];
+	morse_fist_t fist = morse_fist(), keyer = 0;
+	waterfall_input_t samples[2 * TEST_SAMPLES_MAX];
+	db_t cw[TEST_SAMPLES_MAX];
 //	const unsigned char *colours = 0;
-	waterfall_t w = 0;
-	int count, i = 0;
+	waterfall_format_t format;
+	waterfall_t w = 0, w2 = 0;
+	waterfall_view_t view;
+	waterfall_schedule_t schedule;
+	struct waterfall_round_struct round;
+	struct waterfall_rank_struct ranks[64];
+	waterfall_transition_t transitions[2 * WATERFALL_TRANSITIONS];
+	int half_bins[] = { 2 * 16, 2 * 19 }, amplitudes[ARRAY_SIZE(half_bins)];
+	pool_t p = 0;
+	unsigned int version;
+	int count, values, bimodality, i = 0;
+
+
+// only complex input has negative channels, from -Fs/2
+
+	ASSERT(!waterfall(WATERFALL_FORMAT_REAL, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, -1, 24, 80, 25));
+	ASSERT(!waterfall(WATERFALL_FORMAT_COMPLEX, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, -TEST_SAMPLE_BLOCK_SIZE / 2 - 1, 24, 80, 25));
+	ASSERT(!waterfall(WATERFALL_FORMAT_COMPLEX, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 0, TEST_SAMPLE_BLOCK_SIZE / 2, 80, 25));
+	ASSERT(!waterfall(WATERFALL_FORMAT_COUNT, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25));
+	w = waterfall(WATERFALL_FORMAT_COMPLEX, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, -TEST_SAMPLE_BLOCK_SIZE / 2, TEST_SAMPLE_BLOCK_SIZE / 2 - 1, 80, 25);
+	ASSERT(w);
+
+	test_tone(samples, 40 * TEST_SAMPLE_BLOCK_SIZE, -2 * 19, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_FORMAT_COMPLEX);
+	waterfall_update(w, samples, 40 * TEST_SAMPLE_BLOCK_SIZE);
+	for(i = -19; i <= 19; i += 38)
+	{
+		waterfall_sync(w, i);
+	}
+	ASSERT(waterfall_colours(w, -19)[TEST_WATERFALL_SAMPLES - 1] > waterfall_colours(w, 19)[TEST_WATERFALL_SAMPLES - 1] + 30);
+if(assert_errors) fprintf(stderr, "channel -19=%d, channel 19=%d\n", waterfall_colours(w, -19)[TEST_WATERFALL_SAMPLES - 1], waterfall_colours(w, 19)[TEST_WATERFALL_SAMPLES - 1]);
+	waterfall_dlete(w);
 
+	for(format = WATERFALL_FORMAT_REAL; format < WATERFALL_FORMAT_COUNT; format++)
+	{
+		values = (format == WATERFALL_FORMAT_COMPLEX) ? 2 : 1;
 
 // Set up received signal
 
-	morse_fist_wpm_set(fist, TEST_SAMPLES_PER_MIN, 15, 15);
-	
-	test_encode_string(samples, fist);
+		morse_fist_wpm_set(fist, TEST_SAMPLES_PER_MIN, 15, 15);
+
+		test_encode_string(samples, fist, format);
 
 
 //fprintf(stderr, "count=%d\n", count);
 
 // actual tests
 
-	w = waterfall(TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
-	
-	ASSERT(w);
-	
-	ASSERT(!waterfall_text(w, 0));
-	ASSERT(!waterfall_text(w, 11));
-	ASSERT(waterfall_text(w, 12));
-	ASSERT(!*waterfall_text(w, 12));
-	ASSERT(waterfall_text(w, 24));
-	ASSERT(!waterfall_text(w, 25));
+		w = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
 
-	count = 0;
-	while(count < (int) ARRAY_SIZE(samples))
-	{
-		i = random() & 0xFF;
+		ASSERT(w);
 
-		if(count + i > (int) ARRAY_SIZE(samples))
+		ASSERT(!waterfall_text(w, 0));
+		ASSERT(!waterfall_text(w, 11));
+		ASSERT(waterfall_text(w, 12));
+		ASSERT(!*waterfall_text(w, 12));
+		ASSERT(waterfall_text(w, 24));
+		ASSERT(!waterfall_text(w, 25));
+
+		count = 0;
+		while(count < TEST_SAMPLES_MAX)
 		{
-			i = (int) ARRAY_SIZE(samples) - count;
+			i = random() & 0xFF;
+
+			if(count + i > TEST_SAMPLES_MAX)
+			{
+				i = TEST_SAMPLES_MAX - count;
+			}
+
+			waterfall_update(w, samples + count * values, i);
+			count += i;
 		}
 
-		waterfall_update(w, samples + count, i);
-		count += i;
-	}
+// the carrier is in channel 19 and nothing is in channel 16
 
-	waterfall_dlete(w);
+		waterfall_sync(w, 16);
+		waterfall_sync(w, 19);
+		for(i = 0; i < TEST_WATERFALL_SAMPLES; i++)
+		{
+			ASSERT(waterfall_colours(w, 19)[i] > waterfall_colours(w, 16)[i] + 10);
+if(assert_errors) fprintf(stderr, "format %d colours[%d]: channel 16=%d, channel 19=%d\n", format, i, waterfall_colours(w, 16)[i], waterfall_colours(w, 19)[i]);
+		}
+
+// the levels count the last samples rows, and a steady carrier has one level
+
+		for(i = 0, count = 0; i < MORSE_LEVELS; i++)
+		{
+			count += atomic_load_explicit(w->levels + (19 - w->first_subchannel) * MORSE_LEVELS + i, memory_order_relaxed);
+		}
+		ASSERT(count == TEST_WATERFALL_SAMPLES);
+		ASSERT(atomic_load_explicit(w->levels + (19 - w->first_subchannel) * MORSE_LEVELS + waterfall_colours(w, 19)[0], memory_order_relaxed) == TEST_WATERFALL_SAMPLES);
+		waterfall_levels(w, 19 - w->first_subchannel, &bimodality);
+		ASSERT(bimodality < WATERFALL_THRESHOLD_BIMODAL);
+
+// each channel has its own floor, the carrier's doesn't lift its neighbour's
+
+		ASSERT(test_floor(w, 19 - w->first_subchannel) > test_floor(w, 16 - w->first_subchannel) + 10);
+		ASSERT(test_floor(w, 19 - w->first_subchannel) <= waterfall_colours(w, 19)[TEST_WATERFALL_SAMPLES - 1] + 1);
+		ASSERT(test_floor(w, 16 - w->first_subchannel) <= waterfall_colours(w, 16)[TEST_WATERFALL_SAMPLES - 1] + 1);
+if(assert_errors) fprintf(stderr, "format %d floors: channel 16=%d, channel 19=%d\n", format, test_floor(w, 16 - w->first_subchannel), test_floor(w, 19 - w->first_subchannel));
+
+// a steady carrier and silence have no keying to decode
+
+		waterfall_sync(w, 19);
+		ASSERT(!waterfall_active(w, 19 - w->first_subchannel));
+		ASSERT(!waterfall_active(w, 16 - w->first_subchannel));
+		ASSERT(!waterfall_symbols(w, 19)[0].mark && !waterfall_symbols(w, 19)[0].space);
+		ASSERT(!waterfall_version(w, 19));
+
+// syncing every channel across a pool decodes the same as one at a time
+
+		w2 = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+		waterfall_update(w2, samples, TEST_SAMPLES_MAX);
+		p = pool(4);
+		waterfall_sync_all(w2, p);
+		pool_dlete(p);
+		waterfall_sync_all(w, 0);
+		for(i = 12; i <= 24; i++)
+		{
+			ASSERT(!memcmp(waterfall_colours(w, i), waterfall_colours(w2, i), TEST_WATERFALL_SAMPLES * sizeof(db_t)));
+			ASSERT(test_same_symbols(waterfall_symbols(w, i), waterfall_symbols(w2, i)));
+			ASSERT(!strcmp(waterfall_text(w, i), waterfall_text(w2, i)));
+if(assert_errors) fprintf(stderr, "format %d channel %d: serial \"%s\", pool \"%s\"\n", format, i, waterfall_text(w, i), waterfall_text(w2, i));
+		}
+		waterfall_dlete(w2);
+
+// a shorter history, not a power of two, is the tail of the longer one
+
+		w2 = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES / 3, 12, 24, 80, 25);
+		waterfall_update(w2, samples, TEST_SAMPLES_MAX);
+		waterfall_sync(w2, 19);
+		ASSERT(!memcmp(waterfall_colours(w, 19) + TEST_WATERFALL_SAMPLES - TEST_WATERFALL_SAMPLES / 3, waterfall_colours(w2, 19), (TEST_WATERFALL_SAMPLES / 3) * sizeof(db_t)));
+		waterfall_dlete(w2);
+
+// a view reads the same energy in place, until the DSP laps it
+
+		w2 = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+		waterfall_update(w2, samples, TEST_SAMPLES_MAX);
+		ASSERT(waterfall_view(w2, 11, &view));
+		ASSERT(!waterfall_view(w2, 19, &view));
+		for(i = 0; i < TEST_WATERFALL_SAMPLES; i++)
+		{
+			ASSERT(WATERFALL_VIEW(&view, i) == waterfall_colours(w, 19)[i]);
+		}
+		ASSERT(waterfall_view_valid(w2, &view));
+// and an idle channel's symbols and text are left alone however many rows
+// go by, so its version doesn't change either
+		ASSERT(!waterfall_version(w2, 19));
+		waterfall_sync(w2, 19);
+		version = waterfall_version(w2, 19);
+		waterfall_update(w2, samples, TEST_SAMPLES_MAX);
+		ASSERT(!waterfall_view_valid(w2, &view));
+		waterfall_sync(w2, 19);
+		ASSERT(!waterfall_active(w2, 19 - w2->first_subchannel));
+		ASSERT(waterfall_version(w2, 19) == version);
+		waterfall_clear(w2, 19);
+		ASSERT(waterfall_version(w2, 19) != version);
+		waterfall_dlete(w2);
+
+// a sliding DFT hopping a whole block sees what the block transform sees
+
+		ASSERT(waterfall_channeliser_set(w, WATERFALL_CHANNELISER_SLIDING, 0, WATERFALL_WINDOW_NONE));
+		ASSERT(waterfall_channeliser_set(w, WATERFALL_CHANNELISER_SLIDING, TEST_SAMPLE_BLOCK_SIZE + 1, WATERFALL_WINDOW_NONE));
+		ASSERT(waterfall_channeliser_set(w, WATERFALL_CHANNELISER_COUNT, TEST_SAMPLE_BLOCK_SIZE, WATERFALL_WINDOW_NONE));
+
+		w2 = test_waterfall(format, samples, TEST_SAMPLES_MAX, WATERFALL_CHANNELISER_SLIDING, TEST_SAMPLE_BLOCK_SIZE, WATERFALL_WINDOW_NONE);
+		for(i = 1; i < TEST_WATERFALL_SAMPLES; i++)
+		{
+			ASSERT(abs(waterfall_colours(w, 19)[i] - waterfall_colours(w2, 19)[i]) <= 1);
+if(assert_errors) fprintf(stderr, "format %d colours[%d]: block=%d, sliding=%d\n", format, i, waterfall_colours(w, 19)[i], waterfall_colours(w2, 19)[i]);
+		}
+		waterfall_dlete(w2);
+
+		waterfall_dlete(w);
+
+// half a block hop gives twice the energy samples
+
+		test_tone(samples, TEST_SAMPLES_MAX, 2 * 19, 20 * TEST_SAMPLE_BLOCK_SIZE, format);
+
+		w = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_BLOCK, 0, WATERFALL_WINDOW_NONE);
+		w2 = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_SLIDING, TEST_SAMPLE_BLOCK_SIZE / 2, WATERFALL_WINDOW_HANN);
+		count = test_count_above(waterfall_colours(w, 19), 20);
+		ASSERT(count == 20);
+		i = test_count_above(waterfall_colours(w2, 19), 20);
+		ASSERT(i >= 2 * count - 2 && i <= 2 * count + 2);
+if(assert_errors) fprintf(stderr, "format %d energy samples: block=%d, sliding=%d\n", format, count, i);
+		waterfall_dlete(w2);
+		waterfall_dlete(w);
+
+// windows cut the leakage of a tone between channels
+
+		test_tone(samples, TEST_SAMPLES_MAX, 2 * 16 + 1, TEST_SAMPLES_MAX, format);
+
+		w = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_SLIDING, TEST_SAMPLE_BLOCK_SIZE, WATERFALL_WINDOW_NONE);
+		w2 = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_SLIDING, TEST_SAMPLE_BLOCK_SIZE, WATERFALL_WINDOW_BLACKMAN);
+		ASSERT(waterfall_colours(w, 16)[TEST_WATERFALL_SAMPLES - 1] < waterfall_colours(w2, 16)[TEST_WATERFALL_SAMPLES - 1] + 3);
+		ASSERT(waterfall_colours(w, 22)[TEST_WATERFALL_SAMPLES - 1] > waterfall_colours(w2, 22)[TEST_WATERFALL_SAMPLES - 1] + 15);
+if(assert_errors) fprintf(stderr, "format %d channel 16: none=%d, blackman=%d\n", format, waterfall_colours(w, 16)[TEST_WATERFALL_SAMPLES - 1], waterfall_colours(w2, 16)[TEST_WATERFALL_SAMPLES - 1]);
+if(assert_errors) fprintf(stderr, "format %d channel 22: none=%d, blackman=%d\n", format, waterfall_colours(w, 22)[TEST_WATERFALL_SAMPLES - 1], waterfall_colours(w2, 22)[TEST_WATERFALL_SAMPLES - 1]);
+		waterfall_dlete(w2);
+		waterfall_dlete(w);
+
+// the polyphase filterbank keeps a tone between two channels out of the rest
+
+		w = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_BLOCK, 0, WATERFALL_WINDOW_NONE);
+		w2 = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_POLYPHASE, 0, WATERFALL_WINDOW_BLACKMAN);
+		count = test_count_channels(w, 30);
+		i = test_count_channels(w2, 30);
+		ASSERT(count > 4);
+		ASSERT(i == 2);
+		ASSERT(abs(waterfall_colours(w, 16)[TEST_WATERFALL_SAMPLES - 1] - waterfall_colours(w2, 16)[TEST_WATERFALL_SAMPLES - 1]) <= 3);
+if(assert_errors) fprintf(stderr, "format %d channels within 30dB: block=%d, polyphase=%d\n", format, count, i);
+if(assert_errors) for(i = 12; i <= 24; i++) fprintf(stderr, "channel %d: block=%d, polyphase=%d\n", i, waterfall_colours(w, i)[TEST_WATERFALL_SAMPLES - 1], waterfall_colours(w2, i)[TEST_WATERFALL_SAMPLES - 1]);
+		waterfall_dlete(w2);
+		waterfall_dlete(w);
+
+// and gives the same level as a block for a tone in the middle of a channel
+
+		test_tone(samples, TEST_SAMPLES_MAX, 2 * 19, TEST_SAMPLES_MAX, format);
+
+		w = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_BLOCK, 0, WATERFALL_WINDOW_NONE);
+		w2 = test_waterfall(format, samples, 40 * TEST_SAMPLE_BLOCK_SIZE, WATERFALL_CHANNELISER_POLYPHASE, 0, WATERFALL_WINDOW_BLACKMAN);
+		ASSERT(abs(waterfall_colours(w, 19)[TEST_WATERFALL_SAMPLES - 1] - waterfall_colours(w2, 19)[TEST_WATERFALL_SAMPLES - 1]) <= 1);
+if(assert_errors) fprintf(stderr, "format %d channel 19: block=%d, polyphase=%d\n", format, waterfall_colours(w, 19)[TEST_WATERFALL_SAMPLES - 1], waterfall_colours(w2, 19)[TEST_WATERFALL_SAMPLES - 1]);
+		waterfall_dlete(w2);
+		waterfall_dlete(w);
+
+// keying wakes a channel to be decoded, and it is left idle again once it stops
+
+		for(i = 0; i < TEST_SAMPLES_MAX; i++)
+		{
+			if((i >> (TEST_SAMPLE_LOG_BLOCK_SIZE + 2)) & 1)
+			{
+				samples[values * i] = 0;
+				samples[values * i + values - 1] = 0;
+			}
+		}
+
+		w = test_waterfall(format, samples, TEST_SAMPLES_MAX, WATERFALL_CHANNELISER_BLOCK, 0, WATERFALL_WINDOW_NONE);
+		ASSERT(waterfall_active(w, 19 - w->first_subchannel));
+		ASSERT(!waterfall_active(w, 16 - w->first_subchannel));
+		ASSERT(waterfall_symbols(w, 19)[0].mark);
+		ASSERT(!waterfall_symbols(w, 16)[0].mark && !waterfall_symbols(w, 16)[0].space);
+		ASSERT(waterfall_version(w, 19) && !waterfall_version(w, 16));
+if(assert_errors) fprintf(stderr, "format %d crossings: channel 16=%u, channel 19=%u\n", format, atomic_load(w->transition_counts + 16 - w->first_subchannel), atomic_load(w->transition_counts + 19 - w->first_subchannel));
+
+// the keyed channel crosses its threshold every four rows, onto a mark and a
+// space in turn
+
+		count = waterfall_transitions(w, 19, 0, transitions, ARRAY_SIZE(transitions));
+		ASSERT(count > 2 * WATERFALL_ACTIVITY_WAKE && count == (int) atomic_load(w->transition_counts + 19 - w->first_subchannel));
+if(assert_errors) fprintf(stderr, "format %d transitions %d of %u\n", format, count, atomic_load(w->transition_counts + 19 - w->first_subchannel));
+		for(i = 1; i < count; i++)
+		{
+			ASSERT(transitions[i].row == transitions[i - 1].row + 4);
+			ASSERT(transitions[i].mark != transitions[i - 1].mark);
+		}
+		ASSERT(transitions[count - 1].row < atomic_load(&w->head));
+		ASSERT(waterfall_transitions(w, 19, transitions[count - 3].row, transitions, ARRAY_SIZE(transitions)) == 3);
+		ASSERT(waterfall_transitions(w, 19, 0, transitions, 3) == 3 && transitions[2].row == transitions[1].row + 4);
+		ASSERT(!waterfall_transitions(w, 19, transitions[2].row + 1, transitions, ARRAY_SIZE(transitions)));
+		ASSERT(waterfall_transitions(w, 25, 0, transitions, ARRAY_SIZE(transitions)) < 0);
+
+// with the ring just full, the oldest crossing's slot is the next the DSP
+// writes, so it is never read, even while the DSP is half way through it
+
+		w2 = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+		for(i = 0; atomic_load(w2->transition_counts + 19 - w2->first_subchannel) < WATERFALL_TRANSITIONS; i = (i + TEST_SAMPLE_BLOCK_SIZE) % (TEST_SAMPLES_MAX - TEST_SAMPLE_BLOCK_SIZE))
+		{
+			waterfall_update(w2, samples + values * i, TEST_SAMPLE_BLOCK_SIZE);
+		}
+		ASSERT(atomic_load(w2->transition_counts + 19 - w2->first_subchannel) == WATERFALL_TRANSITIONS);
+		w2->transitions[(19 - w2->first_subchannel) * WATERFALL_TRANSITIONS] = atomic_load(&w2->head);
+		count = waterfall_transitions(w2, 19, 0, transitions, ARRAY_SIZE(transitions));
+		ASSERT(count == WATERFALL_TRANSITIONS - 1);
+		for(i = 0; i < count; i++)
+		{
+			ASSERT(transitions[i].mark == !((i + 1) & 1));
+			ASSERT(transitions[i].row < atomic_load(&w2->head));
+			ASSERT(!i || transitions[i].row > transitions[i - 1].row);
+		}
+if(assert_errors) fprintf(stderr, "format %d full ring: %d of %u\n", format, count, atomic_load(w2->transition_counts + 19 - w2->first_subchannel));
+		waterfall_dlete(w2);
+
+// a budgeted round ranks the focus first, then the keyed channel ahead of
+// those only keyed by its leakage, and syncs the idle ones without ranking them
+
+		version = waterfall_version(w, 19);
+		waterfall_update(w, samples, TEST_SAMPLES_MAX);
+		ASSERT(w->subchannels <= (int) ARRAY_SIZE(ranks));
+		round.waterfall = w;
+		round.ranks = ranks;
+		round.ranked = waterfall_rank(w, 16, ranks);
+		round.deadline = 0;
+		atomic_init(&round.next, 0);
+		ASSERT(ranks[0].channel == 16 - w->first_subchannel);
+		ASSERT(ranks[1].channel == 19 - w->first_subchannel);
+		waterfall_sync_ranked(&round, 0, round.ranked);
+		ASSERT(!waterfall_schedule(w, 16, &schedule));
+		ASSERT(!schedule.deferred);
+		ASSERT(schedule.latency == TEST_SAMPLES_MAX >> TEST_SAMPLE_LOG_BLOCK_SIZE);
+		ASSERT(waterfall_schedule(w, 25, &schedule));
+		ASSERT(waterfall_version(w, 19) != version);
+		for(i = 0, count = 1; i < w->subchannels; i++)
+		{
+			count += i != 16 - w->first_subchannel && waterfall_active(w, i);
+		}
+		ASSERT(round.ranked == (int) count);
+if(assert_errors) fprintf(stderr, "format %d ranked %d of %d\n", format, round.ranked, w->subchannels);
+
+// past the deadline the focus is still synced and only the keyed channels
+// put off, and they catch up on the next round
+
+		waterfall_update(w, samples, TEST_SAMPLES_MAX);
+		round.ranked = waterfall_rank(w, 16, ranks);
+		round.deadline = 1;
+		atomic_store(&round.next, 0);
+		waterfall_sync_ranked(&round, 0, round.ranked);
+		for(i = 0; i < w->subchannels; i++)
+		{
+			waterfall_schedule(w, w->first_subchannel + i, &schedule);
+			ASSERT(schedule.deferred == (i != 16 - w->first_subchannel && waterfall_active(w, i)));
+		}
+		waterfall_schedule(w, 19, &schedule);
+		ASSERT(schedule.deferred == 1);
+		waterfall_sync_budget(w, 0, 0, 0);
+		for(i = 12; i <= 24; i++)
+		{
+			ASSERT(!waterfall_schedule(w, i, &schedule));
+			ASSERT(!schedule.deferred);
+			ASSERT(schedule.deferrals <= 1);
+		}
+		ASSERT(waterfall_symbols(w, 19)[0].mark);
+
+// a strong channel that has only just started keying, and so was idle when
+// last synced, still ranks ahead of a weak one that has been keyed all along
+
+		w2 = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+		for(i = 0; i < 3 * TEST_WATERFALL_SAMPLES; i++)
+		{
+			amplitudes[0] = (i >> 1) & 1 ? 30 : 0;
+			amplitudes[1] = i >= 2 * TEST_WATERFALL_SAMPLES && (i / 3) & 1 ? 3000 : 0;
+			test_tones(samples, half_bins, amplitudes, ARRAY_SIZE(amplitudes), format);
+			waterfall_update(w2, samples, TEST_SAMPLE_BLOCK_SIZE);
+			if(i < 2 * TEST_WATERFALL_SAMPLES && !(i % 10)) waterfall_sync_all(w2, 0);
+		}
+		ASSERT(w2->channels[19 - w2->first_subchannel].idle);
+		round.ranked = waterfall_rank(w2, 0, ranks);
+		for(i = 0, count = -1; i < round.ranked; i++)
+		{
+			if(ranks[i].channel == 16 - w2->first_subchannel) break;
+			if(ranks[i].channel == 19 - w2->first_subchannel) count = i;
+		}
+		ASSERT(count >= 0 && i < round.ranked);
+if(assert_errors) fprintf(stderr, "format %d woken channel 19 ranked %d, channel 16 ranked %d of %d\n", format, count, i, round.ranked);
+		waterfall_dlete(w2);
+
+// only the newest crossings are kept
+
+		waterfall_update(w, samples, TEST_SAMPLES_MAX);
+		ASSERT(waterfall_transitions(w, 19, 0, transitions, ARRAY_SIZE(transitions)) == WATERFALL_TRANSITIONS - 1);
+		ASSERT(transitions[WATERFALL_TRANSITIONS - 2].mark == !((atomic_load(w->transition_counts + 19 - w->first_subchannel) - 1) & 1));
+
+		test_tone(samples, TEST_SAMPLES_MAX, 2 * 19, 0, format);
+		waterfall_update(w, samples, TEST_SAMPLES_MAX);
+		waterfall_sync(w, 19);
+		ASSERT(!waterfall_active(w, 19 - w->first_subchannel));
+		ASSERT(!waterfall_symbols(w, 19)[0].mark && !waterfall_symbols(w, 19)[0].space);
+		waterfall_dlete(w);
+
+// text is decoded from the crossings alone, a few rows at a time, however
+// many syncs each character is spread over
+
+		w = waterfall(format, TEST_SAMPLE_LOG_BLOCK_SIZE, TEST_WATERFALL_SAMPLES, 12, 24, 80, 25);
+		keyer = morse_fist();
+		morse_fist_wpm_set(keyer, TEST_SAMPLES_PER_MIN, 30, 30);
+		count = morse_encode(cw, ARRAY_SIZE(cw), 1, TEST_STRING_PARIS, keyer);
+		ASSERT(count < (int) ARRAY_SIZE(cw));
+		for(i = 0; i < count + TEST_WATERFALL_SAMPLES; i++)
+		{
+			test_tone(samples, TEST_SAMPLE_BLOCK_SIZE, 2 * 19, i < count && cw[i] ? TEST_SAMPLE_BLOCK_SIZE : 0, format);
+			waterfall_update(w, samples, TEST_SAMPLE_BLOCK_SIZE);
+			if(!(i % 7)) waterfall_sync(w, 19);
+// sliced between its own levels once they are clear
+			if(i == count - 1) ASSERT(w->slices[19 - w->first_subchannel] > test_floor(w, 19 - w->first_subchannel) + WATERFALL_THRESHOLD_DB);
+		}
+		waterfall_sync(w, 19);
+		ASSERT(strstr(waterfall_text(w, 19), "PARIS PARIS"));
+if(assert_errors) fprintf(stderr, "format %d text \"%s\"\n", format, waterfall_text(w, 19));
+		morse_fist_dlete(keyer);
+		waterfall_dlete(w);
+	}
 
 	return(assert_errors);
 }
@@ -31,27 +31,91 @@
  */
 
 #include "morse.h"
+#include "pool.h"
+
+// input is 16 bit samples, complex (I/Q) input interleaves the real and imaginary parts
+typedef signed short waterfall_input_t;
 
-#if defined(WATERFALL_COMPLEX_INPUT)
 typedef struct waterfall_complex_struct
 {
 	signed short real;
 	signed short imag;
-} waterfall_input_t;
-#else
-typedef signed short waterfall_input_t;
-#endif
+} waterfall_complex_t;
+
+// complex input has channels either side of zero, from -2^(n-1) up to 2^(n-1)-1
+typedef enum
+{
+	WATERFALL_FORMAT_REAL=0,
+	WATERFALL_FORMAT_COMPLEX,
+	WATERFALL_FORMAT_COUNT
+} waterfall_format_t;
 
 typedef struct waterfall_struct *waterfall_t;
 
+// a channel crossing the threshold it is decoded with, onto a mark or onto
+// a space, on energy row row
+typedef struct waterfall_transition_struct
+{
+	unsigned int row;
+	int mark;
+} waterfall_transition_t;
+
+// how a channel fares under waterfall_sync_budget, deferred is the rounds in a
+// row it has been put off, deferrals all of them, and latency how many energy
+// rows behind it was when last synced
+typedef struct waterfall_schedule_struct
+{
+	unsigned int deferred, deferrals, latency;
+} waterfall_schedule_t;
+
+// a channel's energy read in place, value i of samples, oldest first, is
+// WATERFALL_VIEW(view, i), and head is the version, counting energy rows
+typedef struct waterfall_view_struct
+{
+	const db_t *energy;
+	int stride, samples;
+	unsigned int mask, head;
+} waterfall_view_t;
+
+#define WATERFALL_VIEW(view, i)	((view)->energy[(((view)->head - (view)->samples + (unsigned int) (i)) & (view)->mask) * (view)->stride])
+
+// block is one energy sample per transform block, sliding is one per hop of a sliding DFT,
+// polyphase is one per block from a filterbank with a windowed-sinc prototype
+typedef enum
+{
+	WATERFALL_CHANNELISER_BLOCK=0,
+	WATERFALL_CHANNELISER_SLIDING,
+	WATERFALL_CHANNELISER_POLYPHASE,
+	WATERFALL_CHANNELISER_COUNT
+} waterfall_channeliser_t;
+
+typedef enum
+{
+	WATERFALL_WINDOW_NONE=0,
+	WATERFALL_WINDOW_HANN,
+	WATERFALL_WINDOW_BLACKMAN,
+	WATERFALL_WINDOW_COUNT
+} waterfall_window_t;
+
 //waterfall_t waterfall(int input_sampling_power_of_two, int samples, int first_channel, int last_channel);
-waterfall_t waterfall(int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols);
+waterfall_t waterfall(waterfall_format_t format, int input_sampling_power_of_two, int samples, int first_channel, int last_channel, int rows, int cols);
 
 void waterfall_dlete(waterfall_t waterfall);
+int waterfall_channeliser_set(waterfall_t waterfall, waterfall_channeliser_t channeliser, int hop, waterfall_window_t window);
+// input_count is in samples, so complex input holds twice as many values
 void waterfall_update(waterfall_t waterfall, const waterfall_input_t *input, int input_count);
 void waterfall_clear(waterfall_t waterfall, int subchannel);
 
 int waterfall_sync(waterfall_t waterfall, int subchannel);
+// syncs every channel, shared out across the pool's threads, which may be 0 to sync serially
+void waterfall_sync_all(waterfall_t waterfall, pool_t pool);
+// syncs focus, then the keyed channels by signal to noise and staleness, until
+// budget_usec has passed and the rest wait for the next round; idle channels
+// are never kept waiting, focus outside the channels is none, and a budget of
+// 0 or less syncs everything; each call keeps its own round, but like any
+// sync must not run alongside another of the same channels
+void waterfall_sync_budget(waterfall_t waterfall, pool_t pool, int focus, long budget_usec);
+int waterfall_schedule(waterfall_t waterfall, int subchannel, waterfall_schedule_t *schedule);
 
 const db_t *waterfall_colours(waterfall_t waterfall, int subchannel);
 const morse_fist_t waterfall_fist(waterfall_t waterfall, int subchannel);
@@ -59,3 +123,14 @@ const morse_decode_t *waterfall_symbols(waterfall_t waterfall, int subchannel);
 int waterfall_start(waterfall_t waterfall, int subchannel);
 const char *waterfall_text(waterfall_t waterfall, int subchannel);
 int waterfall_text_lines(waterfall_t waterfall, int subchannel);
+
+// lock free while waterfall_update runs in another thread, a view read is
+// torn if waterfall_view_valid says so afterwards
+int waterfall_view(waterfall_t waterfall, int subchannel, waterfall_view_t *view);
+int waterfall_view_valid(waterfall_t waterfall, const waterfall_view_t *view);
+// changes whenever the channel's symbols or text are rewritten, and only then,
+// so an idle channel keeps the same one however many rows go by
+unsigned int waterfall_version(waterfall_t waterfall, int subchannel);
+// copies up to size of the channel's latest crossings on row since or later,
+// oldest first, lock free like a view; only the last 63 are kept
+int waterfall_transitions(waterfall_t waterfall, int subchannel, unsigned int since, waterfall_transition_t *transitions, int size);